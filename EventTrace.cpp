@@ -0,0 +1,84 @@
+#include "EventTrace.h"
+#include <new>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+
+EventTrace::EventTrace() : cells(nullptr), mask(0), tail(0), is_on(false) {}
+
+void EventTrace::init(size_t capacity) {
+    release();
+    if (capacity == 0)
+        return;
+    size_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+    //MAP_NORESERVE and zeroed pages: a large buffer costs nothing until the
+    //events reach it, and a zero sequence is an empty cell.
+    void *mapping = mmap(nullptr, size * sizeof(Cell), PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED)
+        throw std::bad_alloc();
+    cells = (Cell *) mapping;
+    mask = size - 1;
+    tail.store(0, std::memory_order_relaxed);
+}
+
+void EventTrace::release() {
+    is_on.store(false, std::memory_order_relaxed);
+    if (cells != nullptr)
+        munmap(cells, (mask + 1) * sizeof(Cell));
+    cells = nullptr;
+    mask = 0;
+}
+
+bool EventTrace::set_enabled(bool enabled) {
+    if (enabled && cells == nullptr)
+        return false;
+    is_on.store(enabled, std::memory_order_relaxed);
+    return true;
+}
+
+/**
+ * Writes the whole buffer, retrying short writes.
+ * @return false if a write failed.
+ */
+static bool write_all(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0)
+            return false;
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+int EventTrace::dump(int fd) const {
+    uthread_trace_header_t header = {UTHREAD_TRACE_MAGIC, UTHREAD_TRACE_VERSION,
+                                     sizeof(uthread_trace_event_t), 0, 0};
+    std::vector<uthread_trace_event_t> events;
+    if (cells != nullptr) {
+        unsigned long end = tail.load(std::memory_order_acquire);
+        unsigned long start = end > mask + 1 ? end - (mask + 1) : 0;
+        events.reserve(end - start);
+        for (unsigned long ticket = start; ticket < end; ++ticket) {
+            const Cell &cell = cells[ticket & mask];
+            //Skips the cells still being written, or already overwritten by
+            //events recorded during the dump
+            if (cell.sequence.load(std::memory_order_acquire) != ticket + 1)
+                continue;
+            uthread_trace_event_t event = cell.event;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (cell.sequence.load(std::memory_order_relaxed) != ticket + 1)
+                continue;
+            events.push_back(event);
+        }
+        header.dropped = start + (end - start - events.size());
+    }
+    header.count = events.size();
+    if (!write_all(fd, (const char *) &header, sizeof(header)) ||
+        !write_all(fd, (const char *) events.data(), events.size() * sizeof(uthread_trace_event_t)))
+        return -1;
+    return (int) events.size();
+}
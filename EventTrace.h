@@ -0,0 +1,95 @@
+#ifndef _EVENT_TRACE_H_
+#define _EVENT_TRACE_H_
+
+#include "uthreads_trace.h"
+#include <atomic>
+#include <cstddef>
+
+/**
+ * A ring buffer of scheduler events, shared by the workers. A writer takes
+ * the next ticket and fills its cell, so the oldest events are overwritten
+ * once the buffer is full. Each cell carries the ticket that last completed
+ * it, so a dump reads the buffer without any lock while events are recorded,
+ * skipping the cells being written.
+ * The writers must be serialized by the caller, the scheduler records every
+ * event inside its critical section. That keeps the ticket a plain increment,
+ * an atomic one would cost more than the rest of the event.
+ */
+class EventTrace {
+    private:
+        typedef struct Cell {
+            //ticket + 1 once the event of that ticket was stored
+            std::atomic<unsigned long> sequence;
+            uthread_trace_event_t event;
+        } Cell;
+
+        Cell *cells;
+        //The capacity rounded up to a power of 2, minus 1
+        unsigned long mask;
+        std::atomic<unsigned long> tail;
+        std::atomic<bool> is_on;
+
+    public:
+        EventTrace();
+
+        /**
+         * Maps the buffer, dropping the events of a previous one. Memory is
+         * only committed for the cells that get written.
+         * @param capacity - The amount of events kept, 0 for no buffer.
+         * @return Throws std::bad_alloc if the buffer can't be mapped.
+         */
+        void init(size_t capacity);
+
+        /**
+         * Stops recording and unmaps the buffer.
+         */
+        void release();
+
+        /**
+         * @param enabled - Whether events are recorded from now on.
+         * @return false if there is no buffer to record them in.
+         */
+        bool set_enabled(bool enabled);
+
+        /**
+         * A single relaxed load, checked before every event.
+         * @return Whether events are recorded.
+         */
+        bool is_enabled() const {
+            return is_on.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * Stores an event, call only while is_enabled and never concurrently.
+         * Async-signal-safe.
+         * @param time - When it happened, see UThread::clock_ns.
+         * @param type - A uthread_trace_type_t.
+         * @param tid - The thread the event is about.
+         * @param worker - The ID of the worker, -1 for none.
+         * @param arg - Depends on the type.
+         */
+        void record(unsigned long long time, int type, int tid, int worker, int arg) {
+            unsigned long ticket = tail.load(std::memory_order_relaxed);
+            tail.store(ticket + 1, std::memory_order_relaxed);
+            Cell &cell = cells[ticket & mask];
+            //Marks the cell as being written for a dump reading it meanwhile
+            cell.sequence.store(0, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            cell.event.time_ns = time;
+            cell.event.tid = tid;
+            cell.event.worker = (int16_t) worker;
+            cell.event.type = (uint16_t) type;
+            cell.event.arg = arg;
+            cell.sequence.store(ticket + 1, std::memory_order_release);
+        }
+
+        /**
+         * Writes the header and the events in the buffer, from the oldest to
+         * the newest, see uthread_trace_header_t.
+         * @param fd - The file descriptor to write to.
+         * @return The amount of events written, -1 if a write failed.
+         */
+        int dump(int fd) const;
+};
+
+#endif //_EVENT_TRACE_H_
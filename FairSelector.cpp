@@ -0,0 +1,96 @@
+#include "FairSelector.h"
+#include "uthreads_ext.h"
+
+#define NOT_IN_QUEUE (-1)
+//A thread that comes back to the queue may be behind the others by up to a
+//quantum of default weight, so waking up puts it ahead of the busy threads.
+#define WAKE_UP_CREDIT (VRUNTIME_SCALE / UTHREAD_DEFAULT_WEIGHT)
+
+FairSelector::FairSelector(int capacity) : min_vruntime(0) {
+    heap.reserve(capacity);
+}
+
+void FairSelector::place(int index, UThread *v) {
+    heap[index] = v;
+    v->ready_index = index;
+}
+
+void FairSelector::sift_up(int index) {
+    UThread *v = heap[index];
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (heap[parent]->vruntime <= v->vruntime)
+            break;
+        place(index, heap[parent]);
+        index = parent;
+    }
+    place(index, v);
+}
+
+void FairSelector::sift_down(int index) {
+    int size = (int) heap.size();
+    UThread *v = heap[index];
+    while (true) {
+        int child = 2 * index + 1;
+        if (child >= size)
+            break;
+        if (child + 1 < size && heap[child + 1]->vruntime < heap[child]->vruntime)
+            child += 1;
+        if (v->vruntime <= heap[child]->vruntime)
+            break;
+        place(index, heap[child]);
+        index = child;
+    }
+    place(index, v);
+}
+
+UThread *FairSelector::front() {
+    UThread *res = heap.front();
+    remove(res);
+    if (res->vruntime > min_vruntime)
+        min_vruntime = res->vruntime;
+    return res;
+}
+
+void FairSelector::push_back(UThread *v) {
+    if (v->queue != nullptr)
+        return;
+    unsigned long long floor = min_vruntime > WAKE_UP_CREDIT ? min_vruntime - WAKE_UP_CREDIT : 0;
+    if (v->vruntime < floor)
+        v->vruntime = floor;
+    heap.push_back(v);
+    sift_up((int) heap.size() - 1);
+    v->queue = this;
+}
+
+bool FairSelector::is_empty() const {
+    return heap.empty();
+}
+
+int FairSelector::size() const {
+    return (int) heap.size();
+}
+
+void FairSelector::remove(UThread *v) {
+    if (v->queue != this)
+        return;
+    int index = v->ready_index;
+    v->ready_index = NOT_IN_QUEUE;
+    v->queue = nullptr;
+    UThread *last = heap.back();
+    heap.pop_back();
+    if (last == v)
+        return;
+    place(index, last);
+    //The moved thread may belong either above or below its new position.
+    sift_up(index);
+    sift_down(last->ready_index);
+}
+
+void FairSelector::clear() {
+    for (UThread *v: heap) {
+        v->ready_index = NOT_IN_QUEUE;
+        v->queue = nullptr;
+    }
+    heap.clear();
+}
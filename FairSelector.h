@@ -0,0 +1,51 @@
+#ifndef _FAIR_SELECTOR_H_
+#define _FAIR_SELECTOR_H_
+
+#include <vector>
+#include "Selector.h"
+
+/**
+ * The weighted fair policy, in the spirit of the Linux CFS: the thread with
+ * the lowest virtual runtime runs next. Every quantum a thread runs adds to
+ * its virtual runtime in inverse proportion to its weight, so the CPU is
+ * shared in proportion to the weights. A binary min-heap whose positions are
+ * kept inside each UThread, like SleepQueue.
+ */
+class FairSelector : public Selector {
+    private:
+        std::vector<UThread *> heap;
+        //The lowest virtual runtime handed out so far. A thread that was
+        //sleeping, blocked or newly spawned starts about here, so it can't
+        //claim back the time it didn't run.
+        unsigned long long min_vruntime;
+
+        /**
+         * Places the thread at the given position and records it in the thread.
+         */
+        void place(int index, UThread *v);
+
+        void sift_up(int index);
+
+        void sift_down(int index);
+
+    public:
+        /**
+         * @param capacity - The most threads the queue may hold, so pushing
+         * them never reallocates.
+         */
+        explicit FairSelector(int capacity);
+
+        UThread *front() override;
+
+        void push_back(UThread *v) override;
+
+        bool is_empty() const override;
+
+        int size() const override;
+
+        void remove(UThread *v) override;
+
+        void clear() override;
+};
+
+#endif //_FAIR_SELECTOR_H_
@@ -0,0 +1,121 @@
+#include "IOReactor.h"
+#include <cerrno>
+#include <unistd.h>
+
+IOReactor::IOReactor() : epoll_fd(-1), waiting_count(0) {}
+
+int IOReactor::get_fd() const {
+    return epoll_fd;
+}
+
+int IOReactor::init() {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    return epoll_fd < 0 ? -1 : 0;
+}
+
+int IOReactor::arm(int fd, FdWaiters &entry) {
+    struct epoll_event event = {};
+    event.events = EPOLLONESHOT;
+    if (entry.reader != nullptr)
+        event.events |= EPOLLIN | EPOLLRDHUP;
+    if (entry.writer != nullptr)
+        event.events |= EPOLLOUT;
+    event.data.fd = fd;
+    if (entry.is_registered) {
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event) == 0)
+            return 0;
+        //Closing a descriptor unregisters it, the number may have been reused
+        if (errno != ENOENT)
+            return -1;
+    }
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+        return -1;
+    entry.is_registered = true;
+    return 0;
+}
+
+int IOReactor::add_waiter(UThread *thread, int fd, int events) {
+    FdWaiters &entry = waiters.emplace(fd, FdWaiters{nullptr, nullptr, false}).first->second;
+    if (((events & EPOLLIN) && entry.reader != nullptr) ||
+        ((events & EPOLLOUT) && entry.writer != nullptr)) {
+        errno = EBUSY;
+        return -1;
+    }
+    if (events & EPOLLIN)
+        entry.reader = thread;
+    if (events & EPOLLOUT)
+        entry.writer = thread;
+    if (arm(fd, entry) < 0) {
+        if (events & EPOLLIN)
+            entry.reader = nullptr;
+        if (events & EPOLLOUT)
+            entry.writer = nullptr;
+        return -1;
+    }
+    thread->wait_for_io(fd);
+    waiting_count += 1;
+    return 0;
+}
+
+void IOReactor::remove_waiter(UThread *thread) {
+    if (!thread->is_waiting_io)
+        return;
+    auto it = waiters.find(thread->get_io_fd());
+    if (it != waiters.end()) {
+        if (it->second.reader == thread)
+            it->second.reader = nullptr;
+        if (it->second.writer == thread)
+            it->second.writer = nullptr;
+    }
+    thread->is_waiting_io = false;
+    waiting_count -= 1;
+}
+
+bool IOReactor::has_waiters() const {
+    return waiting_count > 0;
+}
+
+int IOReactor::wait(struct epoll_event *events, int timeout_ms) const {
+    int count = epoll_wait(epoll_fd, events, MAX_IO_EVENTS, timeout_ms);
+    return count < 0 ? 0 : count;
+}
+
+int IOReactor::take_ready(const struct epoll_event *events, int count, UThread **ready) {
+    int ready_count = 0;
+    for (int i = 0; i < count; i++) {
+        auto it = waiters.find(events[i].data.fd);
+        if (it == waiters.end())
+            continue;
+        FdWaiters &entry = it->second;
+        //Errors and hang-ups wake both directions, the next call reports them
+        uint32_t failed = events[i].events & (EPOLLERR | EPOLLHUP);
+        UThread *woken[2] = {nullptr, nullptr};
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP) || failed)
+            woken[0] = entry.reader;
+        if (events[i].events & EPOLLOUT || failed)
+            woken[1] = entry.writer;
+        for (UThread *thread: woken) {
+            if (thread == nullptr)
+                continue;
+            //A thread waiting for both directions leaves both and is woken once
+            if (entry.reader == thread)
+                entry.reader = nullptr;
+            if (entry.writer == thread)
+                entry.writer = nullptr;
+            if (!thread->is_waiting_io)
+                continue;
+            thread->is_waiting_io = false;
+            waiting_count -= 1;
+            ready[ready_count++] = thread;
+        }
+        //The event disarmed the descriptor, re-arm it for whoever still waits
+        if (entry.reader != nullptr || entry.writer != nullptr)
+            arm(events[i].data.fd, entry);
+    }
+    return ready_count;
+}
+
+void IOReactor::clear() {
+    waiters.clear();
+    waiting_count = 0;
+}
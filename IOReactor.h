@@ -0,0 +1,93 @@
+#ifndef _IO_REACTOR_H_
+#define _IO_REACTOR_H_
+
+#include <unordered_map>
+#include <sys/epoll.h>
+#include "UThread.h"
+
+#define MAX_IO_EVENTS 64
+
+/**
+ * Tracks the threads that wait for a file descriptor to become ready and
+ * polls an epoll instance for them. Every descriptor is registered with
+ * EPOLLONESHOT, so a readiness event is reported to a single worker and the
+ * descriptor is re-armed only while someone waits for it.
+ */
+class IOReactor {
+    private:
+        typedef struct FdWaiters {
+            UThread *reader;
+            UThread *writer;
+            bool is_registered;
+        } FdWaiters;
+
+        int epoll_fd;
+        int waiting_count;
+        std::unordered_map<int, FdWaiters> waiters;
+
+        /**
+         * Arms the descriptor for the directions its waiters are interested in.
+         * @return 0 on success, -1 otherwise (errno is set by epoll_ctl).
+         */
+        int arm(int fd, FdWaiters &entry);
+
+    public:
+        IOReactor();
+
+        /**
+         * Creates the epoll instance.
+         * @return 0 on success, -1 otherwise.
+         */
+        int init();
+
+        /**
+         * Makes the given thread wait for the descriptor to become ready.
+         * Only one thread may wait for each direction of a descriptor.
+         * @param thread - The waiting thread.
+         * @param fd - The file descriptor.
+         * @param events - EPOLLIN, EPOLLOUT or both.
+         * @return 0 on success, -1 otherwise.
+         */
+        int add_waiter(UThread *thread, int fd, int events);
+
+        /**
+         * Stops the given thread from waiting, if it waits for a descriptor.
+         * @param thread - The thread the caller wants to remove.
+         */
+        void remove_waiter(UThread *thread);
+
+        /**
+         * @return A boolean value whether any thread waits for a descriptor.
+         */
+        bool has_waiters() const;
+
+        /**
+         * @return The epoll instance, readable when a waited descriptor is.
+         */
+        int get_fd() const;
+
+        /**
+         * Waits for readiness events, doesn't touch the waiters so it may run
+         * outside of the scheduler critical section.
+         * @param events - Where to store the events, MAX_IO_EVENTS of them.
+         * @param timeout_ms - As in epoll_wait.
+         * @return The amount of events.
+         */
+        int wait(struct epoll_event *events, int timeout_ms) const;
+
+        /**
+         * Removes the threads that the given events are for from the waiters.
+         * @param events - Events returned by wait.
+         * @param count - The amount of events.
+         * @param ready - Where to store the threads, room for 2 * count.
+         * @return The amount of threads stored in ready.
+         */
+        int take_ready(const struct epoll_event *events, int count, UThread **ready);
+
+        /**
+         * Forgets all the waiters.
+         */
+        void clear();
+};
+
+#endif //_IO_REACTOR_H_
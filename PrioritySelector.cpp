@@ -0,0 +1,77 @@
+#include "PrioritySelector.h"
+
+PrioritySelector::PrioritySelector() : non_empty_levels(0), count(0) {
+    for (int i = 0; i < UTHREAD_PRIORITY_LEVELS; i++)
+        heads[i] = tails[i] = nullptr;
+}
+
+UThread *PrioritySelector::front() {
+    int level = 31 - __builtin_clz(non_empty_levels);
+    UThread *res = heads[level];
+    remove(res);
+    return res;
+}
+
+void PrioritySelector::push_back(UThread *v) {
+    if (v->queue != nullptr)
+        return;
+    int level = v->priority;
+    v->queue_prev = tails[level];
+    v->queue_next = nullptr;
+    if (tails[level] != nullptr)
+        tails[level]->queue_next = v;
+    else
+        heads[level] = v;
+    tails[level] = v;
+    non_empty_levels |= 1u << level;
+    v->queue = this;
+    count += 1;
+}
+
+void PrioritySelector::push_front(UThread *v) {
+    if (v->queue != nullptr)
+        return;
+    int level = v->priority;
+    v->queue_prev = nullptr;
+    v->queue_next = heads[level];
+    if (heads[level] != nullptr)
+        heads[level]->queue_prev = v;
+    else
+        tails[level] = v;
+    heads[level] = v;
+    non_empty_levels |= 1u << level;
+    v->queue = this;
+    count += 1;
+}
+
+bool PrioritySelector::is_empty() const {
+    return non_empty_levels == 0;
+}
+
+int PrioritySelector::size() const {
+    return count;
+}
+
+void PrioritySelector::remove(UThread *v) {
+    if (v->queue != this)
+        return;
+    int level = v->priority;
+    if (v->queue_prev != nullptr)
+        v->queue_prev->queue_next = v->queue_next;
+    else
+        heads[level] = v->queue_next;
+    if (v->queue_next != nullptr)
+        v->queue_next->queue_prev = v->queue_prev;
+    else
+        tails[level] = v->queue_prev;
+    if (heads[level] == nullptr)
+        non_empty_levels &= ~(1u << level);
+    v->queue_prev = v->queue_next = nullptr;
+    v->queue = nullptr;
+    count -= 1;
+}
+
+void PrioritySelector::clear() {
+    while (!is_empty())
+        front();
+}
@@ -0,0 +1,42 @@
+#ifndef _PRIORITY_SELECTOR_H_
+#define _PRIORITY_SELECTOR_H_
+
+#include "Selector.h"
+#include "uthreads_ext.h"
+
+/**
+ * The strict priority policy: a FIFO per priority level, the first thread of
+ * the highest non-empty level runs next, and threads of the same priority
+ * share the CPU in round robin. Lower priorities only run while no higher
+ * one is READY. A bitmap of the non-empty levels makes every operation take
+ * constant time.
+ */
+class PrioritySelector : public Selector {
+    private:
+        UThread *heads[UTHREAD_PRIORITY_LEVELS];
+        UThread *tails[UTHREAD_PRIORITY_LEVELS];
+        //Bit i is set while level i isn't empty.
+        unsigned int non_empty_levels;
+        int count;
+    public:
+        PrioritySelector();
+
+        UThread *front() override;
+
+        void push_back(UThread *v) override;
+
+        /**
+         * Adds the thread ahead of the others of its priority.
+         */
+        void push_front(UThread *v) override;
+
+        bool is_empty() const override;
+
+        int size() const override;
+
+        void remove(UThread *v) override;
+
+        void clear() override;
+};
+
+#endif //_PRIORITY_SELECTOR_H_
@@ -1,24 +1,66 @@
 #include "RoundRobinSelector.h"
 
-thread_ptr RoundRobinSelector::front() {
-    thread_ptr res = pool.front();
-    pool.pop_front();
+RoundRobinSelector::RoundRobinSelector() : head(nullptr), tail(nullptr), count(0) {}
+
+UThread *RoundRobinSelector::front() {
+    UThread *res = head;
+    remove(res);
     return res;
 }
 
-void RoundRobinSelector::push_back(thread_ptr v) {
-    pool.push_back(v);
+void RoundRobinSelector::push_back(UThread *v) {
+    if (v->queue != nullptr)
+        return;
+    v->queue_prev = tail;
+    v->queue_next = nullptr;
+    if (tail != nullptr)
+        tail->queue_next = v;
+    else
+        head = v;
+    tail = v;
+    v->queue = this;
+    count += 1;
+}
+
+void RoundRobinSelector::push_front(UThread *v) {
+    if (v->queue != nullptr)
+        return;
+    v->queue_prev = nullptr;
+    v->queue_next = head;
+    if (head != nullptr)
+        head->queue_prev = v;
+    else
+        tail = v;
+    head = v;
+    v->queue = this;
+    count += 1;
 }
 
 bool RoundRobinSelector::is_empty() const {
-    return pool.empty();
+    return head == nullptr;
 }
 
-void RoundRobinSelector::remove(thread_ptr v) {
-    pool.remove(v);
+int RoundRobinSelector::size() const {
+    return count;
 }
 
-void RoundRobinSelector::clear() {
-    pool.clear();
+void RoundRobinSelector::remove(UThread *v) {
+    if (v->queue != this)
+        return;
+    if (v->queue_prev != nullptr)
+        v->queue_prev->queue_next = v->queue_next;
+    else
+        head = v->queue_next;
+    if (v->queue_next != nullptr)
+        v->queue_next->queue_prev = v->queue_prev;
+    else
+        tail = v->queue_prev;
+    v->queue_prev = v->queue_next = nullptr;
+    v->queue = nullptr;
+    count -= 1;
 }
 
+void RoundRobinSelector::clear() {
+    while (head != nullptr)
+        remove(head);
+}
@@ -1,41 +1,60 @@
 #ifndef _ROUND_ROBIN_SELECTOR_H_
 #define _ROUND_ROBIN_SELECTOR_H_
 
-#include <list>
-#include "UThread.h"
-
-class RoundRobinSelector {
+#include "Selector.h"
+
+/**
+ * The round robin policy, a FIFO of threads. Also used as the wait queue of
+ * the synchronization objects. The links live inside each UThread, so no
+ * operation allocates memory or touches a reference count, and all of them
+ * take constant time.
+ */
+class RoundRobinSelector : public Selector {
     private:
-        std::list<thread_ptr> pool;
+        UThread *head;
+        UThread *tail;
+        int count;
     public:
+        RoundRobinSelector();
+
         /**
          * Pops the first item of the list and returns it to the caller.
          * @return A pointer to the thread who is currently RUNNING.
          */
-        thread_ptr front();
+        UThread *front() override;
 
         /**
-         * Pushes the given pointer to the back of the list.
+         * Pushes the given pointer to the back of the list. A thread that is
+         * already in the list keeps its place.
          * @param v - The thread pointer the callers wants to add to the list.
          */
-        void push_back(thread_ptr v);
+        void push_back(UThread *v) override;
+
+        /**
+         * Pushes the given pointer to the front of the list. A thread that is
+         * already in the list keeps its place.
+         * @param v - The thread pointer the callers wants to add to the list.
+         */
+        void push_front(UThread *v) override;
 
         /**
          * @return A boolean value whether the list is empty or not.
          */
-        bool is_empty() const;
+        bool is_empty() const override;
+
+        int size() const override;
 
         /**
-         * Removes a given pointer from the list.
+         * Removes a given pointer from the list, if it is in this list.
          * @param v  - The thread pointer the callers wants to remove.
          */
-        void remove(thread_ptr v);
+        void remove(UThread *v) override;
 
         /**
-         * Frees all the memory the instance is currently using.
+         * Unlinks all the threads in the list.
          */
-        void clear();
+        void clear() override;
 
 };
 
-#endif //_ROUND_ROBIN_SELECTOR_H_
\ No newline at end of file
+#endif //_ROUND_ROBIN_SELECTOR_H_
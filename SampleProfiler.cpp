@@ -0,0 +1,213 @@
+#include "SampleProfiler.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+SampleProfiler::SampleProfiler() : stacks(nullptr), stacks_mask(0), stack_count(0),
+                                   counts(nullptr), counts_mask(0), count_count(0),
+                                   is_on(false) {}
+
+/**
+ * @return The smallest power of 2 that is at least the given amount.
+ */
+static size_t round_up_power_of_2(size_t amount) {
+    size_t size = 1;
+    while (size < amount)
+        size <<= 1;
+    return size;
+}
+
+/**
+ * Maps zeroed memory that is only committed once it's written, zeroed
+ * entries are the unused ones.
+ */
+static void *map_table(size_t size) {
+    void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED)
+        throw std::bad_alloc();
+    return mapping;
+}
+
+void SampleProfiler::init(size_t max_stacks) {
+    release();
+    if (max_stacks == 0)
+        return;
+    //Kept at most 3/4 full so a probe ends quickly. A stack is usually
+    //sampled in a single thread, the counts get twice the room for the
+    //others.
+    size_t stack_capacity = round_up_power_of_2(max_stacks + max_stacks / 3);
+    size_t count_capacity = 2 * stack_capacity;
+    stacks = (StackEntry *) map_table(stack_capacity * sizeof(StackEntry));
+    try {
+        counts = (Count *) map_table(count_capacity * sizeof(Count));
+    }
+    catch (std::bad_alloc &e) {
+        munmap(stacks, stack_capacity * sizeof(StackEntry));
+        stacks = nullptr;
+        throw;
+    }
+    stacks_mask = stack_capacity - 1;
+    counts_mask = count_capacity - 1;
+}
+
+void SampleProfiler::release() {
+    is_on.store(false, std::memory_order_relaxed);
+    if (stacks != nullptr) {
+        munmap(stacks, (stacks_mask + 1) * sizeof(StackEntry));
+        munmap(counts, (counts_mask + 1) * sizeof(Count));
+    }
+    stacks = nullptr;
+    counts = nullptr;
+    stacks_mask = counts_mask = 0;
+    stack_count = count_count = 0;
+}
+
+bool SampleProfiler::set_enabled(bool enabled) {
+    if (enabled && stacks == nullptr)
+        return false;
+    is_on.store(enabled, std::memory_order_relaxed);
+    return true;
+}
+
+int SampleProfiler::intern(const uintptr_t *pcs, int depth) {
+    //FNV-1a over the addresses
+    unsigned long hash = 14695981039346656037UL;
+    for (int i = 0; i < depth; i++)
+        hash = (hash ^ pcs[i]) * 1099511628211UL;
+    for (size_t index = hash & stacks_mask;; index = (index + 1) & stacks_mask) {
+        StackEntry &entry = stacks[index];
+        if (entry.depth == 0) {
+            if (4 * (stack_count + 1) > 3 * (stacks_mask + 1))
+                return -1;
+            entry.hash = hash;
+            entry.depth = depth;
+            memcpy(entry.pcs, pcs, depth * sizeof(uintptr_t));
+            stack_count += 1;
+            return (int) index;
+        }
+        if (entry.hash == hash && entry.depth == depth &&
+            memcmp(entry.pcs, pcs, depth * sizeof(uintptr_t)) == 0)
+            return (int) index;
+    }
+}
+
+SampleProfiler::Count *SampleProfiler::find_count(int tid, int stack) {
+    unsigned long hash = ((unsigned long) stack * 0x9E3779B97F4A7C15UL) ^ (unsigned long) tid;
+    for (size_t index = hash & counts_mask;; index = (index + 1) & counts_mask) {
+        Count &count = counts[index];
+        if (count.samples == 0) {
+            if (4 * (count_count + 1) > 3 * (counts_mask + 1))
+                return nullptr;
+            count.tid = tid;
+            count.stack = stack;
+            count_count += 1;
+            return &count;
+        }
+        if (count.stack == stack && count.tid == tid)
+            return &count;
+    }
+}
+
+void SampleProfiler::sample(int tid, const ucontext_t *context, const Stack &stack) {
+#if defined(__x86_64__)
+    uintptr_t pcs[PROFILE_MAX_DEPTH];
+    int depth = 0;
+    pcs[depth++] = context->uc_mcontext.gregs[REG_RIP];
+    //Frames live between the interrupted stack pointer and the top of the
+    //stack, every frame holds the caller's frame pointer and a return address
+    uintptr_t low = context->uc_mcontext.gregs[REG_RSP];
+    uintptr_t high = (uintptr_t) (stack.base + stack.size);
+    uintptr_t frame = context->uc_mcontext.gregs[REG_RBP];
+    while (depth < PROFILE_MAX_DEPTH && frame >= low && frame + 2 * sizeof(uintptr_t) <= high &&
+           frame % sizeof(uintptr_t) == 0) {
+        uintptr_t caller_frame = ((uintptr_t *) frame)[0];
+        uintptr_t return_address = ((uintptr_t *) frame)[1];
+        if (return_address == 0)
+            break;
+        pcs[depth++] = return_address;
+        //Frames of callers are always higher, anything else isn't a frame
+        if (caller_frame <= frame)
+            break;
+        frame = caller_frame;
+    }
+    int index = intern(pcs, depth);
+    if (index < 0)
+        return;
+    //A new count is taken by its first sample
+    Count *count = find_count(tid, index);
+    if (count != nullptr)
+        count->samples += 1;
+#else
+    //Only x86-64 has a known frame layout, like ThreadContext
+    (void) tid;
+    (void) context;
+    (void) stack;
+#endif
+}
+
+void SampleProfiler::take_counts(int tid, std::vector<Count> &out) const {
+    if (counts == nullptr)
+        return;
+    for (size_t index = 0; index <= counts_mask; index++)
+        if (counts[index].samples != 0 && (tid == -1 || counts[index].tid == tid))
+            out.push_back(counts[index]);
+}
+
+void SampleProfiler::frame_name(uintptr_t pc, bool is_return, char *name, size_t size) {
+    Dl_info info;
+    uintptr_t address = is_return ? pc - 1 : pc;
+    if (dladdr((void *) address, &info) == 0) {
+        snprintf(name, size, "0x%lx", (unsigned long) pc);
+        return;
+    }
+    if (info.dli_sname != nullptr) {
+        int status;
+        char *demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        snprintf(name, size, "%s", status == 0 ? demangled : info.dli_sname);
+        free(demangled);
+        return;
+    }
+    //Offline symbolization needs the module and the offset in it, addr2line
+    //takes the offset of an executable as is
+    const char *module = info.dli_fname != nullptr ? strrchr(info.dli_fname, '/') : nullptr;
+    module = module != nullptr ? module + 1 : (info.dli_fname != nullptr ? info.dli_fname : "?");
+    snprintf(name, size, "%s+0x%lx", module, (unsigned long) (address - (uintptr_t) info.dli_fbase));
+}
+
+bool SampleProfiler::write_folded(int fd, const std::vector<Count> &counts) const {
+    //A line holds at most PROFILE_MAX_DEPTH names of up to a few hundred
+    //bytes, a longer one is cut
+    char line[16384];
+    char name[512];
+    for (const Count &count: counts) {
+        const StackEntry &entry = stacks[count.stack];
+        size_t length = snprintf(line, sizeof(line), "uthread %d", count.tid);
+        //Folded stacks start from the outermost frame
+        for (int i = entry.depth - 1; i >= 0 && length < sizeof(line); i--) {
+            frame_name(entry.pcs[i], i != 0, name, sizeof(name));
+            //';' separates the frames, a name can't contain it
+            for (char *c = name; *c != '\0'; c++)
+                if (*c == ';')
+                    *c = ':';
+            length += snprintf(line + length, sizeof(line) - length, ";%s", name);
+        }
+        if (length >= sizeof(line) - 32)
+            length = sizeof(line) - 32;
+        length += snprintf(line + length, sizeof(line) - length, " %lu\n", count.samples);
+        const char *data = line;
+        while (length > 0) {
+            ssize_t written = write(fd, data, length);
+            if (written < 0)
+                return false;
+            data += written;
+            length -= written;
+        }
+    }
+    return true;
+}
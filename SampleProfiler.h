@@ -0,0 +1,132 @@
+#ifndef _SAMPLE_PROFILER_H_
+#define _SAMPLE_PROFILER_H_
+
+#include "StackAllocator.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <ucontext.h>
+
+//The most frames of a sample, the interrupted PC included.
+#define PROFILE_MAX_DEPTH 32
+
+/**
+ * Aggregates the samples the preemption timer takes of the running threads.
+ * A sample is the interrupted PC and the return addresses found by walking
+ * the frame pointers. Every distinct stack is stored once, and a sample only
+ * adds to the count of its thread and stack, so the memory grows with the
+ * distinct stacks rather than with the samples. Both tables are sized at init
+ * and never allocate, a sample that finds them full is dropped.
+ * The samples must be serialized by the caller, the timer handler takes them
+ * inside the scheduler critical section.
+ */
+class SampleProfiler {
+    public:
+        /**
+         * How often a thread was interrupted in a stack.
+         */
+        typedef struct Count {
+            int tid;
+            //The index of the stack
+            int stack;
+            //0 for an unused entry
+            unsigned long samples;
+        } Count;
+
+    private:
+        typedef struct StackEntry {
+            unsigned long hash;
+            //0 for an unused entry, a stack has at least the interrupted PC
+            int depth;
+            //From the interrupted PC to the outermost caller
+            uintptr_t pcs[PROFILE_MAX_DEPTH];
+        } StackEntry;
+
+        //Open addressing tables with a power of 2 capacity
+        StackEntry *stacks;
+        size_t stacks_mask;
+        size_t stack_count;
+        Count *counts;
+        size_t counts_mask;
+        size_t count_count;
+        std::atomic<bool> is_on;
+
+        /**
+         * Finds a stack, or stores it if it's new.
+         * @return Its index, -1 if the table is full.
+         */
+        int intern(const uintptr_t *pcs, int depth);
+
+        /**
+         * @return The count of the thread in the stack, nullptr if the table
+         * is full.
+         */
+        Count *find_count(int tid, int stack);
+
+        /**
+         * The name of a frame for a folded stack: its symbol if the dynamic
+         * symbol table has it, its module and offset otherwise.
+         * @param pc - The address.
+         * @param is_return - Whether it's a return address rather than the
+         * interrupted PC, it's then looked up one byte back, in the call.
+         * @param name - Where to write the name.
+         * @param size - The size of name.
+         */
+        static void frame_name(uintptr_t pc, bool is_return, char *name, size_t size);
+
+    public:
+        SampleProfiler();
+
+        /**
+         * Maps the tables, dropping the samples of previous ones. Memory is
+         * only committed for the entries that get written.
+         * @param max_stacks - The amount of distinct stacks kept, 0 for no
+         * tables.
+         * @return Throws std::bad_alloc if the tables can't be mapped.
+         */
+        void init(size_t max_stacks);
+
+        /**
+         * Stops sampling and unmaps the tables.
+         */
+        void release();
+
+        /**
+         * @param enabled - Whether samples are taken from now on.
+         * @return false if there are no tables to keep them in.
+         */
+        bool set_enabled(bool enabled);
+
+        bool is_enabled() const {
+            return is_on.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * Takes a sample, async-signal-safe. Only reads the stack of the
+         * thread, a frame pointer that leads out of it ends the walk, so code
+         * built without frame pointers gives short stacks rather than faults.
+         * @param tid - The ID of the interrupted thread.
+         * @param context - Its context, the third argument of the handler.
+         * @param stack - Its stack.
+         */
+        void sample(int tid, const ucontext_t *context, const Stack &stack);
+
+        /**
+         * Copies the counts of a thread, or of every thread.
+         * @param tid - The ID of the thread, -1 for every thread.
+         * @param out - Where to append them.
+         */
+        void take_counts(int tid, std::vector<Count> &out) const;
+
+        /**
+         * Writes counts in the folded stack format of flamegraph.pl, one line
+         * per thread and stack: "uthread <tid>;<outermost>;...;<pc> <count>".
+         * @param fd - The file descriptor to write to.
+         * @param counts - Counts taken with take_counts.
+         * @return false if a write failed.
+         */
+        bool write_folded(int fd, const std::vector<Count> &counts) const;
+};
+
+#endif //_SAMPLE_PROFILER_H_
@@ -0,0 +1,61 @@
+#ifndef _SELECTOR_H_
+#define _SELECTOR_H_
+
+#include "UThread.h"
+
+/**
+ * A scheduling policy: holds the READY threads of a worker and decides which
+ * one runs next. The threads are linked through fields inside each UThread,
+ * so no policy allocates memory while scheduling.
+ */
+class Selector {
+    public:
+        virtual ~Selector() = default;
+
+        /**
+         * Removes the thread that should run next and returns it.
+         * @return The thread that should run next, the selector must not be
+         * empty.
+         */
+        virtual UThread *front() = 0;
+
+        /**
+         * Adds the given thread to the selector. A thread that is already in
+         * the selector keeps its place.
+         * @param v - The thread pointer the callers wants to add.
+         */
+        virtual void push_back(UThread *v) = 0;
+
+        /**
+         * Adds the given thread so it runs before the threads already in the
+         * selector. Policies that order the threads by themselves add it like
+         * push_back.
+         * @param v - The thread pointer the callers wants to add.
+         */
+        virtual void push_front(UThread *v) {
+            push_back(v);
+        }
+
+        /**
+         * @return A boolean value whether the selector is empty or not.
+         */
+        virtual bool is_empty() const = 0;
+
+        /**
+         * @return The amount of threads in the selector.
+         */
+        virtual int size() const = 0;
+
+        /**
+         * Removes a given thread from the selector, if it is in this selector.
+         * @param v  - The thread pointer the callers wants to remove.
+         */
+        virtual void remove(UThread *v) = 0;
+
+        /**
+         * Unlinks all the threads in the selector.
+         */
+        virtual void clear() = 0;
+};
+
+#endif //_SELECTOR_H_
@@ -0,0 +1,70 @@
+#include "SharedStack.h"
+#include "UThread.h"
+#include <cstdio>
+#include <cstdlib>
+
+//The switcher only copies and switches, it needs little room of its own.
+#define SWITCHER_STACK_SIZE 4096
+
+SharedStack::SharedStack() : stack{nullptr, 0}, switcher_stack{nullptr, 0},
+                             switcher_context{nullptr}, owner(nullptr), target(nullptr) {}
+
+SharedStack &SharedStack::getInstance() {
+    static SharedStack instance;
+    return instance;
+}
+
+void SharedStack::init(size_t size) {
+    release();
+    StackAllocator &allocator = StackAllocator::getInstance();
+    stack = allocator.allocate(size);
+    try {
+        switcher_stack = allocator.allocate(SWITCHER_STACK_SIZE);
+    }
+    catch (std::bad_alloc &e) {
+        allocator.release(stack);
+        stack = {nullptr, 0};
+        throw;
+    }
+    context_make(&switcher_context, switcher_stack.base, switcher_stack.size, switcher_main, this);
+}
+
+void SharedStack::release() {
+    StackAllocator &allocator = StackAllocator::getInstance();
+    allocator.release(stack);
+    allocator.release(switcher_stack);
+    stack = switcher_stack = {nullptr, 0};
+    owner = target = nullptr;
+}
+
+char *SharedStack::get_top() const {
+    return (char *) ((unsigned long) (stack.base + stack.size) & ~0xFUL);
+}
+
+ThreadContext *SharedStack::context_to_resume(UThread *thread) {
+    if (thread == owner)
+        return &thread->context;
+    target = thread;
+    return &switcher_context;
+}
+
+void SharedStack::forget(UThread *thread) {
+    if (owner == thread)
+        owner = nullptr;
+}
+
+void SharedStack::switcher_main(void *arg) {
+    SharedStack *shared = (SharedStack *) arg;
+    while (true) {
+        //A terminated owner is never resumed, its frames are dropped
+        if (shared->owner != nullptr && shared->owner->state != TERMINATED &&
+            !shared->owner->save_stack(shared->get_top())) {
+            fprintf(stderr, "System error: bad alloc\n");
+            exit(1);
+        }
+        UThread *thread = shared->target;
+        thread->restore_stack();
+        shared->owner = thread;
+        context_switch(&shared->switcher_context, &thread->context);
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef _SHARED_STACK_H_
+#define _SHARED_STACK_H_
+
+#include "StackAllocator.h"
+#include "ThreadContext.h"
+
+class UThread;
+
+/**
+ * The execution stack shared by the threads of the shared stack mode, see
+ * uthread_config_t. Only one of them has its frames on the stack at a time,
+ * the owner. The others keep a copy of the live part of their stack, from
+ * their saved stack pointer to the top, and a thread is copied back when
+ * it's resumed. The copies are made by a switcher context that runs on a
+ * stack of its own, since no thread may overwrite the stack it runs on.
+ * A thread keeps the same stack addresses on every resume, so the mode
+ * needs a single worker.
+ */
+class SharedStack {
+    private:
+        //base is nullptr while the mode is off
+        Stack stack;
+        Stack switcher_stack;
+        ThreadContext switcher_context;
+        //The thread whose frames are on the stack, nullptr if there is none
+        UThread *owner;
+        //The thread the switcher copies back and resumes next
+        UThread *target;
+
+        SharedStack();
+
+        /**
+         * The loop of the switcher context: saves the owner, restores the
+         * target and switches to it. Resumed here on the next switch.
+         * @param arg - The SharedStack.
+         */
+        static void switcher_main(void *arg);
+
+    public:
+        SharedStack(SharedStack const &) = delete;
+
+        void operator=(SharedStack const &) = delete;
+
+        static SharedStack &getInstance();
+
+        /**
+         * Maps the shared stack and the stack of the switcher.
+         * @param size - The size of the shared stack in bytes, the deepest a
+         * thread in the mode may go.
+         * @return Throws std::bad_alloc if the stacks can't be mapped.
+         */
+        void init(size_t size);
+
+        /**
+         * Unmaps the stacks and turns the mode off.
+         */
+        void release();
+
+        /**
+         * @return Whether threads are created on the shared stack.
+         */
+        bool is_enabled() const {
+            return stack.base != nullptr;
+        }
+
+        /**
+         * @return The shared stack, given to every thread of the mode.
+         */
+        Stack get_stack() const {
+            return stack;
+        }
+
+        /**
+         * @param thread_stack - The stack of a thread.
+         * @return Whether it's the shared stack.
+         */
+        bool is_shared(Stack thread_stack) const {
+            return thread_stack.base != nullptr && thread_stack.base == stack.base;
+        }
+
+        /**
+         * @return The address the frames of the threads end at, 16 bytes
+         * aligned like the top of every stack, see context_make.
+         */
+        char *get_top() const;
+
+        /**
+         * The context to switch to in order to resume a thread of the mode:
+         * its own if its frames are on the shared stack, the switcher's if
+         * they have to be copied back first.
+         * @param thread - The thread to resume, on the shared stack.
+         * @return The context.
+         */
+        ThreadContext *context_to_resume(UThread *thread);
+
+        /**
+         * Drops a thread that is destroyed, its frames on the stack are
+         * overwritten without being saved.
+         * @param thread - The thread.
+         */
+        void forget(UThread *thread);
+};
+
+#endif //_SHARED_STACK_H_
@@ -0,0 +1,84 @@
+#include "SleepQueue.h"
+
+#define NOT_IN_QUEUE (-1)
+
+SleepQueue::SleepQueue(bool is_timed) : is_timed(is_timed) {}
+
+void SleepQueue::reserve(int capacity) {
+    heap.reserve(capacity);
+}
+
+void SleepQueue::place(int index, UThread *v) {
+    heap[index] = v;
+    v->sleep_index = index;
+}
+
+void SleepQueue::sift_up(int index) {
+    UThread *v = heap[index];
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (wake_key(heap[parent]) <= wake_key(v))
+            break;
+        place(index, heap[parent]);
+        index = parent;
+    }
+    place(index, v);
+}
+
+void SleepQueue::sift_down(int index) {
+    int size = (int) heap.size();
+    UThread *v = heap[index];
+    while (true) {
+        int child = 2 * index + 1;
+        if (child >= size)
+            break;
+        if (child + 1 < size && wake_key(heap[child + 1]) < wake_key(heap[child]))
+            child += 1;
+        if (wake_key(v) <= wake_key(heap[child]))
+            break;
+        place(index, heap[child]);
+        index = child;
+    }
+    place(index, v);
+}
+
+void SleepQueue::push(UThread *v) {
+    heap.push_back(v);
+    sift_up((int) heap.size() - 1);
+}
+
+UThread *SleepQueue::top() const {
+    return heap.front();
+}
+
+UThread *SleepQueue::pop() {
+    UThread *res = heap.front();
+    remove(res);
+    return res;
+}
+
+void SleepQueue::remove(UThread *v) {
+    int index = v->sleep_index;
+    //The position may be in the other queue of sleepers
+    if (index == NOT_IN_QUEUE || index >= (int) heap.size() || heap[index] != v)
+        return;
+    v->sleep_index = NOT_IN_QUEUE;
+    UThread *last = heap.back();
+    heap.pop_back();
+    if (last == v)
+        return;
+    place(index, last);
+    //The moved thread may belong either above or below its new position.
+    sift_up(index);
+    sift_down(last->sleep_index);
+}
+
+bool SleepQueue::is_empty() const {
+    return heap.empty();
+}
+
+void SleepQueue::clear() {
+    for (UThread *v: heap)
+        v->sleep_index = NOT_IN_QUEUE;
+    heap.clear();
+}
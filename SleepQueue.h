@@ -0,0 +1,82 @@
+#ifndef _SLEEP_QUEUE_H_
+#define _SLEEP_QUEUE_H_
+
+#include <vector>
+#include "UThread.h"
+
+/**
+ * The sleeping threads, ordered by the quantum they should wake up at, or by
+ * the time for a queue of threads that sleep for a duration.
+ * A binary min-heap whose positions are kept inside each UThread, so a tick
+ * only looks at the threads that are due and any sleeper can be removed in
+ * O(log n) without searching for it.
+ */
+class SleepQueue {
+    private:
+        std::vector<UThread *> heap;
+        //Ordered by wake_time rather than wake_quantum
+        bool is_timed;
+
+        unsigned long long wake_key(const UThread *v) const {
+            return is_timed ? v->wake_time : (unsigned long long) v->wake_quantum;
+        }
+
+        /**
+         * Places the thread at the given position and records it in the thread.
+         */
+        void place(int index, UThread *v);
+
+        void sift_up(int index);
+
+        void sift_down(int index);
+
+    public:
+        /**
+         * @param is_timed - Whether the threads are ordered by the time they
+         * wake up at (see UThread::sleep_until_time) rather than the quantum.
+         */
+        explicit SleepQueue(bool is_timed = false);
+
+        /**
+         * Makes room for the given amount of threads, so pushing them never
+         * reallocates.
+         * @param capacity - The most threads that may sleep at once.
+         */
+        void reserve(int capacity);
+
+        /**
+         * Adds a thread to the queue according to its wake-up quantum or time.
+         * @param v - A sleeping thread that is not in the queue.
+         */
+        void push(UThread *v);
+
+        /**
+         * @return The thread that should wake up first, without removing it.
+         */
+        UThread *top() const;
+
+        /**
+         * Removes the thread that should wake up first and returns it.
+         * @return The thread that should wake up first.
+         */
+        UThread *pop();
+
+        /**
+         * Removes a given thread from the queue, if it is there. A thread
+         * sleeps in one queue at a time, so it may be removed from every one.
+         * @param v - The thread the caller wants to remove.
+         */
+        void remove(UThread *v);
+
+        /**
+         * @return A boolean value whether the queue is empty or not.
+         */
+        bool is_empty() const;
+
+        /**
+         * Removes all the threads from the queue.
+         */
+        void clear();
+};
+
+#endif //_SLEEP_QUEUE_H_
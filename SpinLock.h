@@ -0,0 +1,27 @@
+#ifndef _SPIN_LOCK_H_
+#define _SPIN_LOCK_H_
+
+#include <atomic>
+
+/**
+ * A test-and-test-and-set lock. It isn't owned by a kernel thread, so it can
+ * be taken by one user thread and released by the one it switches to.
+ */
+class SpinLock {
+    private:
+        std::atomic<bool> locked;
+    public:
+        SpinLock() : locked(false) {}
+
+        void lock() {
+            while (locked.exchange(true, std::memory_order_acquire))
+                while (locked.load(std::memory_order_relaxed))
+                    __builtin_ia32_pause();
+        }
+
+        void unlock() {
+            locked.store(false, std::memory_order_release);
+        }
+};
+
+#endif //_SPIN_LOCK_H_
@@ -0,0 +1,102 @@
+#include "StackAllocator.h"
+#include "uthreads.h"
+#include <new>
+#include <csignal>
+#include <sys/auxv.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+//Upper bound on the number of idle stacks kept around for reuse, unless
+//set_cache_limit is called.
+#define MAX_CACHED_STACKS MAX_THREAD_NUM
+//Room for the signal handler frames on top of the kernel's signal frame.
+#define SIGNAL_HANDLER_STACK_SIZE 4096
+
+StackAllocator::StackAllocator() {
+    page_size = (size_t) sysconf(_SC_PAGESIZE);
+    guard_size = page_size;
+    //The kernel reports the size of its signal frame, which grows with the
+    //extended register state of the CPU (e.g. AVX-512 or AMX).
+    size_t kernel_frame_size = (size_t) getauxval(AT_MINSIGSTKSZ);
+    if (kernel_frame_size < (size_t) MINSIGSTKSZ)
+        kernel_frame_size = MINSIGSTKSZ;
+    signal_frame_size = kernel_frame_size + SIGNAL_HANDLER_STACK_SIZE;
+    cached_count = 0;
+    cache_limit = MAX_CACHED_STACKS;
+}
+
+StackAllocator &StackAllocator::getInstance() {
+    static StackAllocator instance;
+    return instance;
+}
+
+void StackAllocator::set_guarded(bool guarded) {
+    size_t new_guard_size = guarded ? page_size : 0;
+    if (new_guard_size == guard_size)
+        return;
+    //The cached stacks were mapped with the other layout
+    clear();
+    guard_size = new_guard_size;
+}
+
+void StackAllocator::set_cache_limit(size_t limit) {
+    cache_limit = limit;
+}
+
+Stack StackAllocator::allocate(size_t size) {
+    size += signal_frame_size;
+    size = (size + page_size - 1) & ~(page_size - 1);
+    auto it = free_stacks.find(size);
+    if (it != free_stacks.end() && !it->second.empty()) {
+        Stack stack = it->second.back();
+        it->second.pop_back();
+        cached_count -= 1;
+        return stack;
+    }
+    //MAP_NORESERVE keeps untouched pages out of both RSS and the commit charge.
+    void *mapping = mmap(nullptr, size + guard_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK,
+                         -1, 0);
+    if (mapping == MAP_FAILED)
+        throw std::bad_alloc();
+    //Stacks grow down, so the guard page is the lowest page of the mapping.
+    if (guard_size != 0 && mprotect(mapping, guard_size, PROT_NONE) < 0) {
+        munmap(mapping, size + guard_size);
+        throw std::bad_alloc();
+    }
+    return {(char *) mapping + guard_size, size};
+}
+
+void StackAllocator::release(Stack stack) {
+    if (stack.base == nullptr)
+        return;
+    if (cached_count >= cache_limit) {
+        unmap(stack);
+        return;
+    }
+    try {
+        free_stacks[stack.size].push_back(stack);
+        cached_count += 1;
+    }
+    catch (std::bad_alloc &e) {
+        unmap(stack);
+    }
+}
+
+bool StackAllocator::is_guard_page(const void *addr, Stack stack) const {
+    const char *guard = stack.base - guard_size;
+    return stack.base != nullptr && (const char *) addr >= guard &&
+           (const char *) addr < stack.base;
+}
+
+void StackAllocator::clear() {
+    for (auto &entry: free_stacks)
+        for (Stack &stack: entry.second)
+            unmap(stack);
+    free_stacks.clear();
+    cached_count = 0;
+}
+
+void StackAllocator::unmap(Stack stack) const {
+    munmap(stack.base - guard_size, stack.size + guard_size);
+}
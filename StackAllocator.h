@@ -0,0 +1,93 @@
+#ifndef _STACK_ALLOCATOR_H_
+#define _STACK_ALLOCATOR_H_
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+/**
+ * A thread stack. "base" is the lowest usable address, the page right below
+ * it is a PROT_NONE guard page unless the allocator is unguarded.
+ */
+typedef struct Stack {
+    char *base;
+    size_t size;
+} Stack;
+
+class StackAllocator {
+    private:
+        size_t page_size;
+        //The size of the guard page below every stack, 0 when unguarded.
+        size_t guard_size;
+        //Room the kernel needs to push a signal frame, added to every stack.
+        size_t signal_frame_size;
+        size_t cached_count;
+        //The number of stacks cached at most, released ones are unmapped once
+        //it's reached.
+        size_t cache_limit;
+        //Stacks of terminated threads, by usable size.
+        std::map<size_t, std::vector<Stack> > free_stacks;
+
+        StackAllocator();
+
+        /**
+         * Unmaps the given stack together with its guard page, if it has one.
+         * @param stack - The stack to unmap.
+         */
+        void unmap(Stack stack) const;
+
+    public:
+        StackAllocator(StackAllocator const &) = delete;
+
+        void operator=(StackAllocator const &) = delete;
+
+        static StackAllocator &getInstance();
+
+        /**
+         * Chooses whether new stacks get a guard page. A guarded stack takes
+         * two memory mappings, unguarded stacks that are next to each other
+         * share one. Drops the cached stacks when it changes.
+         * @param guarded - Whether stacks are guarded, the default.
+         */
+        void set_guarded(bool guarded);
+
+        /**
+         * Sets how many stacks of terminated threads are kept for reuse. Up to
+         * the thread limit, a burst of exits doesn't unmap the stacks the next
+         * burst of spawns maps again.
+         * @param limit - The number of cached stacks at most.
+         */
+        void set_cache_limit(size_t limit);
+
+        /**
+         * Returns a stack of at least the given size, recycling the stack of a
+         * terminated thread when one of the same size is cached. New stacks are
+         * mapped lazily so memory is only committed when it is touched.
+         * Preemption signals are delivered on the stack of the running thread,
+         * so the room for a signal frame is added on top of the given size.
+         * @param size - The requested usable size in bytes.
+         * @return The allocated stack, throws std::bad_alloc on failure.
+         */
+        Stack allocate(size_t size);
+
+        /**
+         * Gives a stack back to the allocator so it can be reused.
+         * @param stack - A stack returned by allocate.
+         */
+        void release(Stack stack);
+
+        /**
+         * @param addr - An address.
+         * @param stack - A stack returned by allocate.
+         * @return A boolean value whether the address is in the guard page of
+         * the stack, always false for unguarded stacks.
+         */
+        bool is_guard_page(const void *addr, Stack stack) const;
+
+        /**
+         * Unmaps all the cached stacks.
+         */
+        void clear();
+};
+
+#endif //_STACK_ALLOCATOR_H_
@@ -0,0 +1,103 @@
+#ifndef _SYNC_STATE_H_
+#define _SYNC_STATE_H_
+
+#include "RoundRobinSelector.h"
+#include "uthreads_ext.h"
+#include <atomic>
+#include <new>
+
+/**
+ * The wait queue of a synchronization object. A zero filled queue is an empty
+ * one, its selector is only constructed in place once a thread waits, so
+ * zero filled objects need no initialization.
+ */
+class LazyWaitQueue {
+    private:
+        bool is_constructed;
+        alignas(RoundRobinSelector) unsigned char storage[sizeof(RoundRobinSelector)];
+
+    public:
+        LazyWaitQueue() : is_constructed(false), storage() {}
+
+        /**
+         * @return The queue, constructed on the first call. Its address never
+         * changes, the waiting threads keep it.
+         */
+        RoundRobinSelector *get() {
+            if (!is_constructed) {
+                new(storage) RoundRobinSelector();
+                is_constructed = true;
+            }
+            return reinterpret_cast<RoundRobinSelector *>(storage);
+        }
+
+        bool is_empty() const {
+            return !is_constructed || reinterpret_cast<const RoundRobinSelector *>(storage)->is_empty();
+        }
+
+        /**
+         * Destroys the selector of an empty queue, which is zero filled again.
+         */
+        void reset() {
+            if (is_constructed)
+                reinterpret_cast<RoundRobinSelector *>(storage)->~RoundRobinSelector();
+            is_constructed = false;
+        }
+};
+
+/**
+ * What a uthread_mutex_t holds.
+ */
+typedef struct MutexState {
+    //0 - unlocked, 1 - locked, 2 - locked and threads may be waiting for it
+    std::atomic<int> state;
+    //The ID of the owning thread plus 1, 0 when unlocked
+    std::atomic<int> owner;
+    LazyWaitQueue waiters;
+
+    MutexState() : state(0), owner(0) {}
+} MutexState;
+
+/**
+ * What a uthread_cond_t holds.
+ */
+typedef struct CondState {
+    //The mutex of the waiting threads
+    MutexState *mutex;
+    LazyWaitQueue waiters;
+
+    CondState() : mutex(nullptr) {}
+} CondState;
+
+/**
+ * What a uthread_sem_t holds.
+ */
+typedef struct SemState {
+    std::atomic<int> count;
+    //The amount of threads that may be waiting in "waiters"
+    std::atomic<int> waiting;
+    LazyWaitQueue waiters;
+
+    explicit SemState(int count) : count(count), waiting(0) {}
+} SemState;
+
+static_assert(sizeof(MutexState) <= sizeof(uthread_mutex_t) &&
+              alignof(MutexState) <= alignof(uthread_mutex_t), "uthread_mutex_t too small");
+static_assert(sizeof(CondState) <= sizeof(uthread_cond_t) &&
+              alignof(CondState) <= alignof(uthread_cond_t), "uthread_cond_t too small");
+static_assert(sizeof(SemState) <= sizeof(uthread_sem_t) &&
+              alignof(SemState) <= alignof(uthread_sem_t), "uthread_sem_t too small");
+
+inline MutexState *state_of(uthread_mutex_t *mutex) {
+    return reinterpret_cast<MutexState *>(mutex->opaque);
+}
+
+inline CondState *state_of(uthread_cond_t *cond) {
+    return reinterpret_cast<CondState *>(cond->opaque);
+}
+
+inline SemState *state_of(uthread_sem_t *sem) {
+    return reinterpret_cast<SemState *>(sem->opaque);
+}
+
+#endif //_SYNC_STATE_H_
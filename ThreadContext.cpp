@@ -0,0 +1,66 @@
+#include "ThreadContext.h"
+
+typedef unsigned long address_t;
+
+#define DEFAULT_MXCSR 0x1F80
+#define DEFAULT_FPU_CW 0x037F
+#define CONTEXT_FRAME_SLOTS 8
+
+extern "C" void context_start();
+
+/*
+ * Saved frame layout, from the saved stack pointer upwards:
+ * [mxcsr|x87 cw] r15 r14 r13 r12 rbx rbp return-address
+ * */
+asm(R"(
+    .text
+    .globl context_switch
+    .type context_switch, @function
+context_switch:
+    pushq %rbp
+    pushq %rbx
+    pushq %r12
+    pushq %r13
+    pushq %r14
+    pushq %r15
+    subq $8, %rsp
+    stmxcsr (%rsp)
+    fnstcw 4(%rsp)
+    movq %rsp, (%rdi)
+    movq (%rsi), %rsp
+    ldmxcsr (%rsp)
+    fldcw 4(%rsp)
+    addq $8, %rsp
+    popq %r15
+    popq %r14
+    popq %r13
+    popq %r12
+    popq %rbx
+    popq %rbp
+    ret
+    .size context_switch, .-context_switch
+
+    .globl context_start
+    .type context_start, @function
+context_start:
+    movq %r13, %rdi
+    callq *%r12
+    ud2
+    .size context_start, .-context_start
+)");
+
+void context_make(ThreadContext *ctx, char *stack, size_t stack_size,
+                  context_entry_point entry, void *arg) {
+    //The top of the stack must be 16 bytes aligned once context_start runs.
+    address_t top = ((address_t) stack + stack_size) & ~(address_t) 0xF;
+    address_t *frame = (address_t *) (top - 16) - CONTEXT_FRAME_SLOTS;
+    frame[0] = DEFAULT_MXCSR | ((address_t) DEFAULT_FPU_CW << 32);
+    frame[1] = 0;                   //r15
+    frame[2] = 0;                   //r14
+    frame[3] = (address_t) arg;     //r13
+    frame[4] = (address_t) entry;   //r12
+    frame[5] = 0;                   //rbx
+    frame[6] = 0;                   //rbp
+    frame[7] = (address_t) context_start;
+    ctx->sp = frame;
+}
@@ -0,0 +1,38 @@
+#ifndef _THREAD_CONTEXT_H_
+#define _THREAD_CONTEXT_H_
+
+#include <cstddef>
+
+/**
+ * The saved execution state of a thread that is not currently running.
+ * The callee-saved registers, the FPU control words and the resume address
+ * are pushed on the thread's own stack, so only the stack pointer is kept.
+ */
+typedef struct ThreadContext {
+    void *sp;
+} ThreadContext;
+
+typedef void (*context_entry_point)(void *);
+
+/**
+ * Saves the current execution state in "from" and resumes the one in "to".
+ * Returns only when some other thread switches back to "from".
+ * No system call is made, the signal mask is left untouched.
+ * @param from - Where to save the state of the calling thread.
+ * @param to - The state to resume.
+ */
+extern "C" void context_switch(ThreadContext *from, ThreadContext *to);
+
+/**
+ * Prepares a context that, once switched to, calls entry(arg) on the given
+ * stack. The entry function must never return.
+ * @param ctx - The context to initialize.
+ * @param stack - The lowest address of the stack.
+ * @param stack_size - The size of the stack in bytes.
+ * @param entry - The function the context starts running.
+ * @param arg - The argument passed to entry.
+ */
+void context_make(ThreadContext *ctx, char *stack, size_t stack_size,
+                  context_entry_point entry, void *arg);
+
+#endif //_THREAD_CONTEXT_H_
@@ -1,7 +1,7 @@
 #ifndef THREAD_STATE__
 #define THREAD_STATE__
 typedef enum ThreadState {
-    READY, RUNNING, BLOCKED
+    READY, RUNNING, BLOCKED, TERMINATED
 } ThreadState;
 
 #endif //THREAD_STATE__
\ No newline at end of file
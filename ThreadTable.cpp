@@ -0,0 +1,95 @@
+#include "ThreadTable.h"
+#include <new>
+#include <sys/mman.h>
+
+/**
+ * Maps zero filled memory whose pages are only committed once touched.
+ * @param size - The size in bytes.
+ * @return The memory, page aligned. Throws std::bad_alloc on failure.
+ */
+static void *map_lazily(size_t size) {
+    void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED)
+        throw std::bad_alloc();
+    return mapping;
+}
+
+ThreadTable::ThreadTable() : capacity(0), slots(nullptr), entries(nullptr) {}
+
+void ThreadTable::init(int capacity) {
+    if (slots != nullptr) {
+        for (int tid = 0; tid < this->capacity; tid++)
+            destroy(tid);
+        munmap(slots, sizeof(UThread) * this->capacity);
+        munmap(entries, sizeof(Entry) * this->capacity);
+        slots = nullptr;
+        entries = nullptr;
+        this->capacity = 0;
+    }
+    //Every slot starts at a cache line, see the layout of UThread. The
+    //mappings are page aligned and zero filled: no thread, no generation.
+    slots = (UThread *) map_lazily(sizeof(UThread) * capacity);
+    try {
+        entries = (Entry *) map_lazily(sizeof(Entry) * capacity);
+    }
+    catch (std::bad_alloc &e) {
+        munmap(slots, sizeof(UThread) * capacity);
+        slots = nullptr;
+        throw;
+    }
+    this->capacity = capacity;
+}
+
+void ThreadTable::destroy(int tid) {
+    if (!entries[tid].is_constructed)
+        return;
+    //A reader that sees the destructor's writes sees the slot emptied, see
+    //is_unchanged
+    std::atomic_thread_fence(std::memory_order_release);
+    slots[tid].~UThread();
+    entries[tid].is_constructed = false;
+}
+
+UThread *ThreadTable::add(int tid, thread_entry_point entry_point, Stack stack) {
+    destroy(tid);
+    UThread *thread = new(&slots[tid]) UThread(tid, entry_point, stack);
+    Entry &entry = entries[tid];
+    entry.is_constructed = true;
+    //The new generation is seen before the thread, which lives at the same
+    //address as the previous one, see find
+    unsigned int generation = entry.generation.load(std::memory_order_relaxed);
+    entry.generation.store(generation % UTHREAD_MAX_GENERATION + 1, std::memory_order_relaxed);
+    entry.thread.store(thread, std::memory_order_release);
+    return thread;
+}
+
+void ThreadTable::remove(int tid) {
+    entries[tid].thread.store(nullptr, std::memory_order_relaxed);
+    destroy(tid);
+}
+
+void ThreadTable::retire(int tid) {
+    entries[tid].thread.store(nullptr, std::memory_order_relaxed);
+}
+
+void ThreadTable::reap(int tid) {
+    destroy(tid);
+}
+
+void ThreadTable::set_result(int tid, void *result) {
+    entries[tid].has_result = true;
+    entries[tid].result = result;
+}
+
+int ThreadTable::take_result(int id, void **result) {
+    int tid = id & UTHREAD_TID_MASK;
+    unsigned int generation = (unsigned int) id >> UTHREAD_TID_BITS;
+    if (id < 0 || tid >= capacity || !entries[tid].has_result)
+        return -1;
+    if (generation != 0 && generation != entries[tid].generation.load(std::memory_order_relaxed))
+        return -1;
+    entries[tid].has_result = false;
+    *result = entries[tid].result;
+    return tid;
+}
@@ -0,0 +1,192 @@
+#ifndef _THREAD_TABLE_H_
+#define _THREAD_TABLE_H_
+
+#include "UThread.h"
+#include "uthreads_ext.h"
+#include <atomic>
+
+/**
+ * Owns every thread. The control blocks live in one array indexed by tid, so
+ * finding a thread is a bounds check and a load, and neither spawning nor
+ * scheduling touches the heap or a reference count. The arrays are sized for
+ * the thread limit but mapped lazily, so only the pages of the tids in use
+ * are committed, and the lowest free tid is always reused first.
+ * The exit value of a terminated joinable thread is kept in its slot until
+ * the thread is joined, the control block itself may be reused by then.
+ * Every slot counts the threads created in it, so a handle (see
+ * uthread_get_handle) of a terminated thread doesn't find the thread that
+ * reused its tid.
+ * The table is changed inside the scheduler critical section only, but a
+ * query that just reads a field of a thread may look it up without the lock,
+ * see find and is_unchanged.
+ */
+class ThreadTable {
+    private:
+        typedef struct Entry {
+            //The existing thread, nullptr for a free tid
+            std::atomic<UThread *> thread;
+            //The generation of the thread in the slot, between 1 and
+            //UTHREAD_MAX_GENERATION, 0 before the first one.
+            std::atomic<unsigned int> generation;
+            //Whether the slot holds a constructed thread, which may have been
+            //retired and not destroyed yet
+            bool is_constructed;
+            //Whether a joinable thread terminated in the slot and nobody
+            //joined it yet, its tid stays taken meanwhile
+            bool has_result;
+            void *result;
+        } Entry;
+
+        int capacity;
+        //Room for a thread per tid, the one with tid i lives in slots[i]
+        UThread *slots;
+        Entry *entries;
+
+        /**
+         * Destroys the thread in the given slot, if there is one.
+         * @param tid - The slot.
+         */
+        void destroy(int tid);
+
+    public:
+        ThreadTable();
+
+        ThreadTable(ThreadTable const &) = delete;
+
+        void operator=(ThreadTable const &) = delete;
+
+        /**
+         * @param id - Any integer, a tid or a handle.
+         * @return The thread with the given ID, nullptr if there is none or
+         * the handle is stale.
+         */
+        UThread *get(int id) const {
+            int tid = id & UTHREAD_TID_MASK;
+            unsigned int generation = (unsigned int) id >> UTHREAD_TID_BITS;
+            if (id < 0 || tid >= capacity)
+                return nullptr;
+            const Entry &entry = entries[tid];
+            if (generation != 0 && generation != entry.generation.load(std::memory_order_relaxed))
+                return nullptr;
+            return entry.thread.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * Looks a thread up without the scheduler lock, like a seqlock reader.
+         * Another worker may remove the thread or reuse its slot meanwhile, so
+         * whatever is read from the thread only counts if is_unchanged
+         * confirms it afterwards.
+         * @param id - Any integer, a tid or a handle.
+         * @param generation - Where to store the generation of the slot.
+         * @return The thread with the given ID, nullptr if there is none or
+         * the handle is stale.
+         */
+        UThread *find(int id, unsigned int &generation) const {
+            int tid = id & UTHREAD_TID_MASK;
+            if (id < 0 || tid >= capacity)
+                return nullptr;
+            const Entry &entry = entries[tid];
+            generation = entry.generation.load(std::memory_order_acquire);
+            unsigned int tagged = (unsigned int) id >> UTHREAD_TID_BITS;
+            if (tagged != 0 && tagged != generation)
+                return nullptr;
+            return entry.thread.load(std::memory_order_acquire);
+        }
+
+        /**
+         * @param id - The ID given to find.
+         * @param thread - The thread find returned.
+         * @param generation - The generation find stored.
+         * @return Whether the slot still held the same thread after the reads
+         * made since find.
+         */
+        bool is_unchanged(int id, const UThread *thread, unsigned int generation) const {
+            const Entry &entry = entries[id & UTHREAD_TID_MASK];
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return entry.thread.load(std::memory_order_relaxed) == thread &&
+                   entry.generation.load(std::memory_order_relaxed) == generation;
+        }
+
+        /**
+         * @param tid - The ID of an existing thread.
+         * @return The handle of the thread: its tid tagged with its generation.
+         */
+        int get_handle(int tid) const {
+            return (int) (entries[tid].generation.load(std::memory_order_relaxed) << UTHREAD_TID_BITS) | tid;
+        }
+
+        /**
+         * Makes room for the given amount of threads, with no thread in any
+         * slot. Reserves address space only, memory is committed as slots are
+         * used.
+         * @param capacity - The tids are between 0 and capacity - 1.
+         * Throws std::bad_alloc on failure.
+         */
+        void init(int capacity);
+
+        /**
+         * Creates a thread in the slot of its tid. A retired thread still in
+         * the slot is destroyed first.
+         * @param tid - A free ID.
+         * @param entry_point - See UThread.
+         * @param stack - See UThread.
+         * @return The new thread.
+         */
+        UThread *add(int tid, thread_entry_point entry_point, Stack stack);
+
+        /**
+         * Destroys the thread with the given ID, which must not be running.
+         * @param tid - The ID of an existing thread.
+         */
+        void remove(int tid);
+
+        /**
+         * Removes the thread with the given ID while it's still running on its
+         * stack. It can't be found anymore but stays constructed until it's
+         * reclaimed by reap, after the switch away from it.
+         * @param tid - The ID of an existing thread.
+         */
+        void retire(int tid);
+
+        /**
+         * Destroys a retired thread, its stack goes back to the StackAllocator.
+         * @param tid - The ID of a retired thread nothing runs on anymore.
+         */
+        void reap(int tid);
+
+        /**
+         * Keeps the exit value of a joinable thread that was removed or
+         * retired, until it's taken.
+         * @param tid - The ID of the thread.
+         * @param result - The exit value.
+         */
+        void set_result(int tid, void *result);
+
+        /**
+         * @param tid - Any ID.
+         * @return Whether the slot keeps an exit value.
+         */
+        bool has_result(int tid) const {
+            return entries[tid].has_result;
+        }
+
+        /**
+         * @param tid - Any ID.
+         * @return Whether the slot holds a thread, a retired one included until
+         * it's reaped.
+         */
+        bool is_constructed(int tid) const {
+            return entries[tid].is_constructed;
+        }
+
+        /**
+         * Takes the exit value of a terminated joinable thread.
+         * @param id - Any integer, a tid or a handle.
+         * @param result - Where to copy the exit value.
+         * @return The tid of the thread, which can be given back, or -1 if
+         * no exit value is kept for the ID or the handle is stale.
+         */
+        int take_result(int id, void **result);
+};
+
+#endif //_THREAD_TABLE_H_
@@ -0,0 +1,55 @@
+#include "TidAllocator.h"
+
+#define BITS_PER_WORD 64
+
+TidAllocator::TidAllocator() : free_count(0) {}
+
+void TidAllocator::init(int capacity) {
+    size_t words = (capacity + BITS_PER_WORD - 1) / BITS_PER_WORD;
+    free_ids.assign(words, ~0ULL);
+    summary.assign((words + BITS_PER_WORD - 1) / BITS_PER_WORD, ~0ULL);
+    //Clear the bits past the last ID and the last word
+    if (capacity % BITS_PER_WORD != 0)
+        free_ids.back() = (1ULL << (capacity % BITS_PER_WORD)) - 1;
+    if (words % BITS_PER_WORD != 0)
+        summary.back() = (1ULL << (words % BITS_PER_WORD)) - 1;
+    free_count = capacity;
+}
+
+int TidAllocator::allocate() {
+    for (size_t i = 0; i < summary.size(); i++) {
+        if (summary[i] == 0)
+            continue;
+        size_t word = i * BITS_PER_WORD + __builtin_ctzll(summary[i]);
+        int bit = __builtin_ctzll(free_ids[word]);
+        free_ids[word] &= free_ids[word] - 1;
+        if (free_ids[word] == 0)
+            summary[i] &= summary[i] - 1;
+        free_count -= 1;
+        return (int) (word * BITS_PER_WORD + bit);
+    }
+    return -1;
+}
+
+void TidAllocator::release(int tid) {
+    size_t word = tid / BITS_PER_WORD;
+    free_ids[word] |= 1ULL << (tid % BITS_PER_WORD);
+    summary[word / BITS_PER_WORD] |= 1ULL << (word % BITS_PER_WORD);
+    free_count += 1;
+}
+
+bool TidAllocator::is_empty() const {
+    return free_count == 0;
+}
+
+int TidAllocator::get_free_count() const {
+    return free_count;
+}
+
+void TidAllocator::clear() {
+    for (uint64_t &word: free_ids)
+        word = 0;
+    for (uint64_t &word: summary)
+        word = 0;
+    free_count = 0;
+}
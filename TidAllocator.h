@@ -0,0 +1,59 @@
+#ifndef _TID_ALLOCATOR_H_
+#define _TID_ALLOCATOR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Hands out the lowest free thread ID. A bitmap of the free IDs plus a
+ * summary bitmap of the words that have a free ID, so allocating is two
+ * find-first-set instructions once the summary word is found, and releasing
+ * sets two bits. Nothing allocates memory after init.
+ */
+class TidAllocator {
+    private:
+        //Bit i % 64 of free_ids[i / 64] is set while ID i is free.
+        std::vector<uint64_t> free_ids;
+        //Bit w % 64 of summary[w / 64] is set while free_ids[w] isn't 0.
+        std::vector<uint64_t> summary;
+        int free_count;
+
+    public:
+        TidAllocator();
+
+        /**
+         * Makes every ID free, a word of IDs at a time.
+         * @param capacity - IDs are between 0 and capacity - 1.
+         */
+        void init(int capacity);
+
+        /**
+         * Takes the lowest free ID.
+         * @return The ID, -1 if there is no free ID.
+         */
+        int allocate();
+
+        /**
+         * Gives an ID back.
+         * @param tid - An ID taken with allocate.
+         */
+        void release(int tid);
+
+        /**
+         * @return A boolean whether there is no free ID.
+         */
+        bool is_empty() const;
+
+        /**
+         * @return The amount of free IDs.
+         */
+        int get_free_count() const;
+
+        /**
+         * Makes every ID taken.
+         */
+        void clear();
+};
+
+#endif //_TID_ALLOCATOR_H_
@@ -1,47 +1,299 @@
 #include "UThread.h"
+#include "UThreadsManager.h"
+#include <ctime>
+#include <cstdlib>
+#include <cstring>
 
-typedef unsigned long address_t;
+//Room for the frame context_make makes, see ThreadContext.cpp
+#define CONTEXT_FIRST_FRAME_SIZE 128
+//Saved frames are sized in steps of this many bytes
+#define SAVED_STACK_ALIGN 128
 
-address_t translate_address(address_t addr) {
-    address_t ret;
-    asm volatile("xor    %%fs:0x30,%0\n"
-                 "rol    $0x11,%0\n"
-            : "=g"(ret)
-            : "0"(addr));
-    return ret;
+void UThread::start(void *arg) {
+    UThread *thread = (UThread *) arg;
+    //Every switch happens inside the scheduler critical section, so a brand
+    //new thread has to leave it itself before running user code.
+    UThreadsManager::on_thread_start();
+    void *result = nullptr;
+    if (thread->routine != nullptr)
+        result = thread->routine(thread->arg);
+    else
+        thread->entry_point();
+    //A thread whose function returns is terminated.
+    uthread_exit(result);
 }
 
-UThread::UThread(int tid, thread_entry_point entry_point) {
+UThread::UThread(int tid, thread_entry_point entry_point, Stack stack) {
     this->tid = tid;
+    this->stack = stack;
     this->state = READY;
+    this->entry_point = entry_point;
+    routine = nullptr;
+    arg = nullptr;
+    is_joinable = false;
+    joiner = nullptr;
+    join_target = nullptr;
+    join_result = nullptr;
+    join_task = nullptr;
     is_sleeping = false;
-    is_blocked = true;
+    is_blocked = false;
+    is_waiting_io = false;
+    is_waiting_sync = false;
+    io_fd = -1;
     quantum_while_running_count = 0;
-    sleep_duration = 0;
-    address_t sp = (address_t) stack + STACK_SIZE - sizeof(address_t);
-    address_t pc = (address_t) entry_point;
-    sigsetjmp(env, 1);
-    (env->__jmpbuf)[JB_SP] = translate_address(sp);
-    (env->__jmpbuf)[JB_PC] = translate_address(pc);
-    sigemptyset(&env->__saved_mask);
+    wake_quantum = 0;
+    wake_time = 0;
+    slice_length = 1;
+    slice_left = 1;
+    has_fixed_slice = false;
+    context.sp = nullptr;
+    queue_prev = queue_next = nullptr;
+    queue = nullptr;
+    sleep_index = -1;
+    ready_index = -1;
+    priority = UTHREAD_DEFAULT_PRIORITY;
+    weight = UTHREAD_DEFAULT_WEIGHT;
+    vruntime = 0;
+    stats = uthread_thread_stats_t();
+    state_since = clock_ns();
+    //Version 0 is never a key's, see UThreadsManager::uthread_key_create
+    for (auto &slot: specific) {
+        slot.value = nullptr;
+        slot.version = 0;
+    }
+    is_stack_shared = SharedStack::getInstance().is_shared(stack);
+    saved_stack = nullptr;
+    saved_size = saved_capacity = 0;
+    //The main thread already runs, its context is saved on its first switch.
+    if (is_stack_shared) {
+        //The stack may hold the frames of another thread, the first frame is
+        //made aside and saved like the frames of a thread that switched out
+        alignas(16) char first_frame[CONTEXT_FIRST_FRAME_SIZE];
+        context_make(&context, first_frame, sizeof(first_frame), start, this);
+        size_t size = first_frame + sizeof(first_frame) - (char *) context.sp;
+        saved_stack = (char *) malloc(SAVED_STACK_ALIGN);
+        if (saved_stack == nullptr)
+            throw std::bad_alloc();
+        memcpy(saved_stack, context.sp, size);
+        saved_size = size;
+        saved_capacity = SAVED_STACK_ALIGN;
+        //The frame holds no addresses of its own, it works at the same
+        //distance from the top of the shared stack
+        context.sp = SharedStack::getInstance().get_top() - size;
+    } else if (stack.base != nullptr)
+        context_make(&context, stack.base, stack.size, start, this);
+}
+
+UThread::~UThread() {
+    if (is_stack_shared) {
+        SharedStack::getInstance().forget(this);
+        free(saved_stack);
+    } else
+        StackAllocator::getInstance().release(stack);
+}
+
+bool UThread::save_stack(const char *top) {
+    size_t size = top - (const char *) context.sp;
+    //Right-sized: grown to fit, shrunk once the frames take under half
+    if (size > saved_capacity || size < saved_capacity / 2) {
+        size_t capacity = (size + SAVED_STACK_ALIGN - 1) & ~(size_t) (SAVED_STACK_ALIGN - 1);
+        char *copy = (char *) realloc(saved_stack, capacity);
+        if (copy == nullptr)
+            return false;
+        saved_stack = copy;
+        saved_capacity = capacity;
+    }
+    memcpy(saved_stack, context.sp, size);
+    saved_size = size;
+    return true;
+}
+
+void UThread::restore_stack() {
+    memcpy(context.sp, saved_stack, saved_size);
+}
+
+void UThread::sleep_until(int quantum) {
+    state = BLOCKED;
+    stats.sleep_count += 1;
+    wake_quantum = quantum;
+    is_sleeping = true;
 }
 
-void UThread::sleep(int quantums) {
+void UThread::sleep_until_time(unsigned long long time) {
     state = BLOCKED;
-    sleep_duration = quantums;
+    stats.sleep_count += 1;
+    wake_time = time;
     is_sleeping = true;
 }
 
-void UThread::block() {
+void UThread::block(unsigned long long now) {
+    set_state(BLOCKED, now);
+    is_blocked = true;
+}
+
+void UThread::set_state(ThreadState state, unsigned long long now) {
+    if (this->state != RUNNING)
+        count_state_time(now);
+    this->state = state;
+}
+
+void UThread::switch_in(unsigned long long now) {
+    count_state_time(now);
+    state = RUNNING;
+}
+
+void UThread::switch_out(unsigned long long now, bool preempted) {
+    stats.running_ns += now - state_since;
+    state_since = now;
+    if (preempted)
+        stats.involuntary_switches += 1;
+    else
+        stats.voluntary_switches += 1;
+}
+
+void UThread::count_state_time(unsigned long long now) {
+    if (now < state_since)
+        now = state_since;
+    unsigned long long elapsed = now - state_since;
+    state_since = now;
+    if (state == READY) {
+        stats.ready_ns += elapsed;
+        if (elapsed > stats.max_ready_wait_ns)
+            stats.max_ready_wait_ns = elapsed;
+    } else if (state == BLOCKED)
+        stats.blocked_ns += elapsed;
+}
+
+uthread_thread_stats_t UThread::get_stats(unsigned long long now) const {
+    uthread_thread_stats_t res = stats;
+    unsigned long long elapsed = now - state_since;
+    if (state == RUNNING)
+        res.running_ns += elapsed;
+    else if (state == READY) {
+        res.ready_ns += elapsed;
+        if (elapsed > res.max_ready_wait_ns)
+            res.max_ready_wait_ns = elapsed;
+    } else if (state == BLOCKED)
+        res.blocked_ns += elapsed;
+    return res;
+}
+
+unsigned long long UThread::clock_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void UThread::wait_for_io(int fd) {
+    state = BLOCKED;
+    io_fd = fd;
+    is_waiting_io = true;
+}
+
+void UThread::wait_on(RoundRobinSelector *wait_queue) {
+    state = BLOCKED;
+    is_waiting_sync = true;
+    wait_queue->push_back(this);
+}
+
+void UThread::set_routine(void *(*routine)(void *), void *arg) {
+    this->routine = routine;
+    this->arg = arg;
+}
+
+void *UThread::take_specific(int slot, unsigned int version) {
+    void *value = get_specific(slot, version);
+    specific[slot].value = nullptr;
+    return value;
+}
+
+void *(*UThread::get_routine() const)(void *) {
+    return routine;
+}
+
+bool UThread::get_joinable() const {
+    return is_joinable;
+}
+
+void UThread::set_joinable(bool joinable) {
+    is_joinable = joinable;
+}
+
+UThread *UThread::get_joiner() const {
+    return joiner;
+}
+
+UThread *UThread::get_join_target() const {
+    return join_target;
+}
+
+void UThread::join(UThread *target) {
     state = BLOCKED;
+    is_waiting_sync = true;
+    join_target = target;
+    target->joiner = this;
+}
+
+UThread *UThread::leave_joins(void *result) {
+    if (join_target != nullptr) {
+        join_target->joiner = nullptr;
+        join_target = nullptr;
+    }
+    UThread *waiting = joiner;
+    joiner = nullptr;
+    if (waiting != nullptr) {
+        waiting->join_target = nullptr;
+        waiting->join_result = result;
+    }
+    return waiting;
+}
+
+void *UThread::get_join_result() const {
+    return join_result;
+}
+
+struct uthread_task_node *UThread::get_join_task() const {
+    return join_task;
+}
+
+void UThread::set_join_task(struct uthread_task_node *task) {
+    join_task = task;
 }
 
-void UThread::notify_sleep() {
-    sleep_duration = std::max(0, sleep_duration - 1);
+bool UThread::is_joined() const {
+    return joiner != nullptr || join_task != nullptr;
 }
 
-bool UThread::has_finished_sleeping() const {
-    return is_sleeping && sleep_duration == 0;
+int UThread::get_io_fd() const {
+    return io_fd;
+}
+
+int UThread::get_wake_quantum() const {
+    return wake_quantum;
+}
+
+unsigned long long UThread::get_wake_time() const {
+    return wake_time;
+}
+
+Selector *UThread::get_queue() const {
+    return queue;
+}
+
+int UThread::get_priority() const {
+    return priority;
+}
+
+void UThread::set_priority(int priority) {
+    this->priority = priority;
+}
+
+int UThread::get_weight() const {
+    return weight;
+}
+
+void UThread::set_weight(int weight) {
+    this->weight = weight;
 }
 
 int UThread::get_tid() const {
@@ -52,6 +304,34 @@ int UThread::get_quantum_count() const {
     return quantum_while_running_count;
 }
 
+void UThread::start_slice() {
+    slice_left = slice_length;
+}
+
+bool UThread::count_slice_quantum() {
+    slice_left -= 1;
+    return slice_left > 0;
+}
+
+void UThread::adapt_slice(bool exhausted) {
+    if (has_fixed_slice)
+        return;
+    if (exhausted)
+        slice_length = std::min(slice_length * 2, UTHREAD_MAX_SLICE);
+    else
+        slice_length = std::max(slice_length / 2, UTHREAD_MIN_SLICE);
+}
+
+void UThread::set_slice(int length, bool fixed) {
+    slice_length = length;
+    has_fixed_slice = fixed;
+}
+
+bool UThread::is_interactive() const {
+    return !has_fixed_slice && slice_length < UTHREAD_INITIAL_SLICE;
+}
+
 void UThread::increment_quantum_count() {
     quantum_while_running_count += 1;
+    vruntime += VRUNTIME_SCALE / weight;
 }
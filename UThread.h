@@ -2,53 +2,398 @@
 #define _USER_THREAD_H_
 
 #include "ThreadState.cpp"
-#include <csetjmp>
+#include "ThreadContext.h"
+#include "StackAllocator.h"
+#include "SharedStack.h"
 #include "uthreads.h"
+#include "uthreads_stats.h"
+#include "uthreads_keys.h"
 #include <csignal>
-#include <memory>
 
 #define MAIN_THREAD_ID 0
-#define JB_SP 6
-#define JB_PC 7
+//The virtual runtime a quantum adds to a thread of weight 1.
+#define VRUNTIME_SCALE (1ULL << 30)
 
-class UThread {
-    private:
-        int tid;
-        int quantum_while_running_count;
-        int sleep_duration;
+class Selector;
+
+class RoundRobinSelector;
+
+struct uthread_task_node;
+
+/**
+ * The control block of a user thread, see ThreadTable. The fields a switch
+ * touches fill the first cache line of the block, the cold ones (entry
+ * point, counters, stack) follow.
+ */
+class alignas(64) UThread {
     public:
         ThreadState state;
-        char stack[STACK_SIZE];
         bool is_sleeping;
         bool is_blocked;
-        sigjmp_buf env;
+        bool is_waiting_io;
+        //Waits in the queue of a mutex, condition variable or semaphore
+        bool is_waiting_sync;
+        ThreadContext context;
+
+    private:
+        friend class RoundRobinSelector;
+        friend class PrioritySelector;
+        friend class FairSelector;
+        friend class SleepQueue;
+        friend class IOReactor;
+
+        int tid;
+        int quantum_while_running_count;
+        //Intrusive links of the READY queue or wait queue the thread is in,
+        //see Selector. "queue" is nullptr when it isn't in any.
+        UThread *queue_prev;
+        UThread *queue_next;
+        Selector *queue;
+        //Position in the SleepQueue, -1 when the thread isn't in it.
+        int sleep_index;
+        //Position in a FairSelector, -1 when the thread isn't in one.
+        int ready_index;
+        int wake_quantum;
+        //The CLOCK_MONOTONIC time a thread sleeping with sleep_until_time
+        //wakes up at, in nanoseconds.
+        unsigned long long wake_time;
+        //The length of the slice of the thread in quantums, and how many of
+        //them are left of the current one.
+        int slice_length;
+        int slice_left;
+        //Whether slice_length was set with uthread_set_quantum
+        bool has_fixed_slice;
+        int priority;
+        //The quantums the thread ran, scaled down by its weight.
+        unsigned long long vruntime;
+        int weight;
+        //The descriptor the thread waits for while is_waiting_io is set.
+        int io_fd;
+        thread_entry_point entry_point;
+        //The function of a thread created with an argument, in place of
+        //entry_point, see uthread_create.
+        void *(*routine)(void *);
+        void *arg;
+        //Whether another thread may join the thread, so its exit value is
+        //kept after it terminates until it's joined.
+        bool is_joinable;
+        //The thread waiting for this one to terminate, and the one this
+        //thread waits for, nullptr when there is none.
+        UThread *joiner;
+        UThread *join_target;
+        //The exit value of the joined thread, handed over when it terminated.
+        void *join_result;
+        //The task that joins the thread in place of a joiner, see
+        //uthread_task_join, nullptr when there is none.
+        struct uthread_task_node *join_task;
+        //When the thread entered its current state, or started running
+        unsigned long long state_since;
+        uthread_thread_stats_t stats;
+        //The values of the thread for the thread-specific data keys, one
+        //slot per key. A value only belongs to the key with the same version,
+        //so a key that was deleted and created again reads NULL.
+        struct {
+            void *value;
+            unsigned int version;
+        } specific[UTHREAD_KEYS_MAX];
+        //Whether the thread runs on the SharedStack, and the copy of its
+        //frames while they aren't on it: saved_size bytes below the top.
+        bool is_stack_shared;
+        char *saved_stack;
+        size_t saved_size;
+        size_t saved_capacity;
+
+        /**
+         * Adds the time since state_since to the counter of the current state,
+         * which isn't RUNNING, and restarts it.
+         * @param now - The current time, see clock_ns. A time read before
+         * state_since, on another worker, counts as no time.
+         */
+        void count_state_time(unsigned long long now);
+
+        /**
+         * The first function every spawned thread runs on its own stack.
+         * @param arg - The UThread that starts running.
+         */
+        static void start(void *arg);
 
-        UThread(int tid, thread_entry_point entry_point);
+    public:
+        Stack stack;
 
+        /**
+         * @param tid - The ID of the thread.
+         * @param entry_point - The function of the thread, nullptr for the main
+         * thread and for threads given a routine with set_routine.
+         * @param stack - The stack the thread runs on, owned by the thread from
+         * now on and given back to the StackAllocator when it is destroyed.
+         * The main thread has none, it already runs on the process stack.
+         * The stack of the SharedStack isn't owned, the thread starts with its
+         * first frame saved instead. Throws std::bad_alloc if it can't be.
+         */
+        UThread(int tid, thread_entry_point entry_point, Stack stack);
+
+        ~UThread();
 
         /**
-         * The method makes the thread "sleep" and changes its sleep_duration to
-         * the given quantums.
-         * @param quantums - The amount of quantums the caller wants the thread to
-         * "sleep".
+         * @return Whether the thread runs on the SharedStack.
          */
-        void sleep(int quantums);
+        bool has_shared_stack() const {
+            return is_stack_shared;
+        }
+
+        /**
+         * Copies the frames of a thread on the SharedStack aside, from its
+         * saved stack pointer to the top. The copy is resized to fit.
+         * @param top - The top of the SharedStack.
+         * @return false if the copy can't be allocated.
+         */
+        bool save_stack(const char *top);
+
+        /**
+         * Copies the saved frames back to the SharedStack.
+         */
+        void restore_stack();
+
+        /**
+         * The method makes the thread "sleep" until the given quantum of the
+         * process starts.
+         * @param quantum - The overall quantum count the thread should wake up
+         * at.
+         */
+        void sleep_until(int quantum);
+
+        /**
+         * The method makes the thread "sleep" until the given time.
+         * @param time - The CLOCK_MONOTONIC time the thread should wake up at,
+         * see clock_ns.
+         */
+        void sleep_until_time(unsigned long long time);
 
         /**
          * Changes the state of the thread to BLOCKED.
+         * @param now - The last clock read of the scheduler, see set_state.
          */
-        void block();
+        void block(unsigned long long now);
 
         /**
-         *  Updates the sleep duration of the thread by reducing it by one (Minimum
-         *  value is 0).
+         * Changes the state of the thread and counts the time it spent in the
+         * previous one. The time of a RUNNING thread is counted when it's
+         * switched out instead.
+         * @param state - The new state.
+         * @param now - The last clock read of the scheduler on the calling
+         * worker, at a switch or a tick, so the change costs no clock read.
          */
-        void notify_sleep();
+        void set_state(ThreadState state, unsigned long long now);
 
         /**
-         * @return A boolean value whether the thread is "sleeping" or not.
+         * Makes the thread RUNNING, counting the time it waited READY.
+         * @param now - The current time, see clock_ns.
          */
-        bool has_finished_sleeping() const;
+        void switch_in(unsigned long long now);
+
+        /**
+         * Counts the time the thread ran when it's switched out.
+         * @param now - The current time, see clock_ns.
+         * @param preempted - Whether the quantum of the thread ended.
+         */
+        void switch_out(unsigned long long now, bool preempted);
+
+        /**
+         * @param now - The current time, see clock_ns.
+         * @return The counters of the thread, including the time in its
+         * current state.
+         */
+        uthread_thread_stats_t get_stats(unsigned long long now) const;
+
+        /**
+         * @return The wall-clock time in nanoseconds, from CLOCK_MONOTONIC.
+         */
+        static unsigned long long clock_ns();
+
+        /**
+         * The method makes the thread wait until the given file descriptor is
+         * ready.
+         * @param fd - The file descriptor the thread waits for.
+         */
+        void wait_for_io(int fd);
+
+        /**
+         * The method makes the thread wait at the end of the wait queue of a
+         * synchronization object until it's handed the object.
+         * @param wait_queue - The wait queue of the object.
+         */
+        void wait_on(RoundRobinSelector *wait_queue);
+
+        /**
+         * Makes the thread run the given function in place of its entry point.
+         * @param routine - The function, its return value is the exit value of
+         * the thread.
+         * @param arg - The argument of the function.
+         */
+        void set_routine(void *(*routine)(void *), void *arg);
+
+        /**
+         * @return The function given with set_routine, nullptr if there is none.
+         */
+        void *(*get_routine() const)(void *);
+
+        /**
+         * @param slot - The slot of a key, below UTHREAD_KEYS_MAX.
+         * @param version - The version of the key.
+         * @return The value of the thread for the key, nullptr if it has none.
+         */
+        void *get_specific(int slot, unsigned int version) const {
+            return specific[slot].version == version ? specific[slot].value : nullptr;
+        }
+
+        /**
+         * @param slot - The slot of a key, below UTHREAD_KEYS_MAX.
+         * @param version - The version of the key.
+         * @param value - The new value of the thread for the key.
+         */
+        void set_specific(int slot, unsigned int version, void *value) {
+            specific[slot].value = value;
+            specific[slot].version = version;
+        }
+
+        /**
+         * @param slot - The slot of a key, below UTHREAD_KEYS_MAX.
+         * @param version - The version of the key.
+         * @return The value of the thread for the key, which is reset to
+         * nullptr, nullptr if it has none.
+         */
+        void *take_specific(int slot, unsigned int version);
+
+        /**
+         * @return Whether another thread may join the thread.
+         */
+        bool get_joinable() const;
+
+        /**
+         * @param joinable - Whether another thread may join the thread.
+         */
+        void set_joinable(bool joinable);
+
+        /**
+         * @return The thread waiting for this one to terminate, nullptr if
+         * there is none.
+         */
+        UThread *get_joiner() const;
+
+        /**
+         * @return The thread this one waits for, nullptr if there is none.
+         */
+        UThread *get_join_target() const;
+
+        /**
+         * The method makes the thread wait until the given one terminates.
+         * @param target - A thread nobody waits for yet.
+         */
+        void join(UThread *target);
+
+        /**
+         * Ends the joins the thread is part of, when it terminates.
+         * @param result - The exit value of the thread.
+         * @return The thread that waited for this one, handed the exit value,
+         * nullptr if there was none.
+         */
+        UThread *leave_joins(void *result);
+
+        /**
+         * @return The exit value the thread was handed by the thread it joined.
+         */
+        void *get_join_result() const;
+
+        /**
+         * @return The task waiting for this thread to terminate, nullptr if
+         * there is none.
+         */
+        struct uthread_task_node *get_join_task() const;
+
+        /**
+         * @param task - The task waiting for this thread to terminate, nullptr
+         * for none.
+         */
+        void set_join_task(struct uthread_task_node *task);
+
+        /**
+         * @return Whether a thread or a task waits for this thread to terminate.
+         */
+        bool is_joined() const;
+
+        /**
+         * @return The file descriptor the thread waits for.
+         */
+        int get_io_fd() const;
+
+        /**
+         * @return The overall quantum count the thread should wake up at.
+         */
+        int get_wake_quantum() const;
+
+        /**
+         * @return The time the thread should wake up at, see sleep_until_time.
+         */
+        unsigned long long get_wake_time() const;
+
+        /**
+         * @return The READY queue or wait queue the thread is in, nullptr if it
+         * isn't in any.
+         */
+        Selector *get_queue() const;
+
+        /**
+         * Starts a new slice, when the thread is switched in.
+         */
+        void start_slice();
+
+        /**
+         * Counts a quantum of the current slice.
+         * @return A boolean value whether the slice goes on.
+         */
+        bool count_slice_quantum();
+
+        /**
+         * Adapts the length of the slice to how the last one ended, unless it
+         * was fixed with set_slice: an ended slice doubles, one the thread
+         * gave up halves.
+         * @param exhausted - Whether the slice ended.
+         */
+        void adapt_slice(bool exhausted);
+
+        /**
+         * @param length - The new length of the slice in quantums, positive.
+         * @param fixed - Whether it's kept as is by adapt_slice.
+         */
+        void set_slice(int length, bool fixed);
+
+        /**
+         * @return A boolean value whether the thread gave up its slices
+         * early, so it should run soon once its wait ends.
+         */
+        bool is_interactive() const;
+
+        /**
+         * @return The priority of the thread, used by PrioritySelector.
+         */
+        int get_priority() const;
+
+        /**
+         * Sets the priority of a thread that isn't in any READY queue.
+         * @param priority - The new priority.
+         */
+        void set_priority(int priority);
+
+        /**
+         * @return The weight of the thread, used by FairSelector.
+         */
+        int get_weight() const;
+
+        /**
+         * Sets the weight of a thread that isn't in any READY queue.
+         * @param weight - The new weight, positive.
+         */
+        void set_weight(int weight);
 
         /**
          * @return The ID of the thread.
@@ -61,12 +406,11 @@ class UThread {
         int get_quantum_count() const;
 
         /**
-         * Increases the amount of quantums the thread has been running by one.
+         * Increases the amount of quantums the thread has been running by one,
+         * and its virtual runtime according to its weight.
          */
         void increment_quantum_count();
 
 };
 
-typedef std::shared_ptr<UThread> thread_ptr;
-
 #endif //_USER_THREAD_H_
\ No newline at end of file
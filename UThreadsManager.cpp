@@ -6,39 +6,184 @@
 
 //added 0 at the end so to enforce using this as a function call requiring semicolon at the end of the invocation
 #define GUARD(predicate, message) if(predicate){ message; return FAILURE;}
+//GUARD for use after BLOCK_SIGNALS, leaves the critical section before failing
+#define GUARD_BLOCKED(predicate, message) if(predicate){ message; UNBLOCK_SIGNALS(); return FAILURE;}
 
 //defining BLOCK_SIGNALS and UNBLOCK_SIGNALS like this enforces us to use BLOCK_SIGNALS if we want to use UNBLOCK_SIGNALS otherwise
 // sigset won't be declared, and also this allows multiple UNBLOCK_SIGNALS statements for the same sigset.
 //essentially creating the desired one-many relationship between BLOCK_SIGNALS and UNBLOCK_SIGNALS respectively
+//Besides masking SIGVTALRM they take the scheduler lock shared by the workers.
+//In cooperative mode there is no timer, so SIGVTALRM is never masked.
+#define MASK_PREEMPTION(how) if (getInstance().is_preemptive) sigprocmask(how,&sigset,NULL)
 #define BLOCK_SIGNALS() sigset_t sigset;sigemptyset(&sigset);sigaddset(&sigset, \
-SIGVTALRM); sigprocmask(SIG_BLOCK,&sigset,NULL)
-#define UNBLOCK_SIGNALS() sigprocmask (SIG_UNBLOCK,&sigset,NULL)
+SIGVTALRM); MASK_PREEMPTION(SIG_BLOCK); getInstance().scheduler_lock.lock()
+#define UNBLOCK_SIGNALS() do { getInstance().scheduler_lock.unlock(); \
+MASK_PREEMPTION(SIG_UNBLOCK); } while (0)
+
+#define OVERFLOW_HANDLER_STACK_SIZE 16384
+#define STACK_OVERFLOW_MESSAGE "Thread library error: stack overflow.\n"
+//How long an idle worker waits before looking for work again.
+#define NSECS_PER_SEC 1000000000LL
+//A thread-specific data key is its slot with the slot's version above it
+#define KEY_SLOT_BITS 5
+#define KEY_SLOT(key) ((key) & ((1 << KEY_SLOT_BITS) - 1))
+#define KEY_VERSION(key) ((unsigned int) (key) >> KEY_SLOT_BITS)
+#define MAX_KEY_VERSION ((1u << (31 - KEY_SLOT_BITS)) - 1)
+
+static_assert(UTHREAD_KEYS_MAX <= 1 << KEY_SLOT_BITS, "KEY_SLOT_BITS too small");
+
+thread_local Worker *UThreadsManager::this_worker = nullptr;
+thread_local UThread *UThreadsManager::this_thread = nullptr;
 
 /*
  * library function
  * */
-int UThreadsManager::uthread_init(int quantum) {
+int UThreadsManager::uthread_init(const uthread_config_t &config) {
+    is_preemptive = config.preemptive != 0;
+    policy = config.policy;
+    timer_source = config.timer_source;
+    is_adaptive = config.adaptive_quantum != 0;
+    int quantum = config.quantum_usecs;
+    int worker_count = config.num_workers;
     BLOCK_SIGNALS();
-    GUARD(
-            quantum <= 0,
+    GUARD_BLOCKED(
+            is_preemptive && quantum <= 0,
             UTHREADS_FAIL("Quantum must be a non negative integer.")
     );
+    GUARD_BLOCKED(
+            worker_count <= 0,
+            UTHREADS_FAIL("The amount of workers must be a positive integer.")
+    );
+    GUARD_BLOCKED(
+            policy != UTHREAD_POLICY_ROUND_ROBIN && policy != UTHREAD_POLICY_PRIORITY &&
+            policy != UTHREAD_POLICY_FAIR,
+            UTHREADS_FAIL("Unknown scheduling policy.")
+    );
+    GUARD_BLOCKED(
+            timer_source != UTHREAD_TIMER_VIRTUAL && timer_source != UTHREAD_TIMER_THREAD_CPU &&
+            timer_source != UTHREAD_TIMER_MONOTONIC,
+            UTHREADS_FAIL("Unknown timer source.")
+    );
+    GUARD_BLOCKED(
+            config.max_threads <= 0 || config.max_threads > UTHREAD_MAX_THREADS,
+            UTHREADS_FAIL("The thread limit must be between 1 and UTHREAD_MAX_THREADS.")
+    );
+    GUARD_BLOCKED(
+            config.stack_size == 0,
+            UTHREADS_FAIL("stack size must be a positive integer")
+    );
+    GUARD_BLOCKED(
+            config.pool_threads <= 0,
+            UTHREADS_FAIL("The pool size must be a positive integer.")
+    );
+    GUARD_BLOCKED(
+            config.shared_stack_size > 0 && worker_count > 1,
+            UTHREADS_FAIL("The shared stack mode needs a single worker.")
+    );
     quantum_length = quantum;
 
+    max_threads = config.max_threads;
+    default_stack_size = config.stack_size;
+    pool_limit = config.pool_threads;
+    //Keys don't outlive the threads of the last initialization, their slot
+    //versions do so an old key never matches a new one
+    for (int slot = 0; slot < UTHREAD_KEYS_MAX; slot++) {
+        if (is_key_used[slot])
+            key_versions[slot] = key_versions[slot] % MAX_KEY_VERSION + 1;
+        is_key_used[slot] = false;
+        key_destructors[slot] = nullptr;
+    }
+    key_count = 0;
+    StackAllocator::getInstance().set_guarded(config.guard_stacks != 0);
+    StackAllocator::getInstance().set_cache_limit((size_t) max_threads);
+
     //Initialize all legal tids in the available_thread_ids DS.
-    for (int i = 0; i < MAX_THREAD_NUM; i++)
-        available_thread_ids.push(i);
+    available_thread_ids.init(max_threads);
 
     //handle "main" thread
     try {
-        thread_ptr main_thread_ptr = std::make_shared<UThread>(available_thread_ids.pop(), nullptr);
-        main_thread_ptr->state = RUNNING;
-        thread_map.insert({0, main_thread_ptr});
-        running_thread = main_thread_ptr;
-        //Start the virtual timer, counts the executing time of the process.
-        init_itimer(quantum);
+        //Sized for the limit up front, but only the pages of the threads that
+        //are created get committed, see ThreadTable::init.
+        threads.init(max_threads);
+        sleeping_threads.reserve(max_threads);
+        timed_sleepers.reserve(max_threads);
+        event_trace.init(config.trace_events);
+        profiler.init(config.profile_stacks);
+        if (config.shared_stack_size > 0)
+            SharedStack::getInstance().init(config.shared_stack_size);
+        else
+            SharedStack::getInstance().release();
+        //The main thread keeps running on the process stack
+        UThread *main_thread = threads.add(available_thread_ids.allocate(), nullptr, Stack{nullptr, 0});
+        main_thread->state = RUNNING;
+        if (is_adaptive)
+            main_thread->set_slice(UTHREAD_INITIAL_SLICE, false);
+        main_thread->start_slice();
+        for (int i = 0; i < worker_count; i++)
+            workers.push_back(new Worker(i, create_selector()));
+        //Idle workers sleep until another one makes a thread READY
+        for (int i = 0; i < worker_count && worker_count > 1; i++) {
+            workers[i]->park_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (workers[i]->park_fd < 0) {
+                SYSCALL_FAIL("eventfd error.");
+                free_all_memory();
+                exit(1);
+            }
+        }
+        Worker *main_worker = workers[0];
+        this_worker = main_worker;
+        this_thread = main_thread;
+        main_worker->thread = pthread_self();
+        main_worker->kernel_tid = gettid();
+        pthread_attr_t attributes;
+        if (pthread_getattr_np(pthread_self(), &attributes) == 0) {
+            void *stack_base;
+            size_t stack_size;
+            if (pthread_attr_getstack(&attributes, &stack_base, &stack_size) == 0)
+                main_stack = {(char *) stack_base, stack_size};
+            pthread_attr_destroy(&attributes);
+        }
+        main_worker->running_thread = main_thread;
+        init_overflow_handler();
+        init_signal_stack(main_worker);
+        if (io_reactor.init() < 0) {
+            SYSCALL_FAIL("epoll_create error.");
+            free_all_memory();
+            exit(1);
+        }
+        if (wakeups.init(max_threads) < 0) {
+            SYSCALL_FAIL("eventfd error.");
+            free_all_memory();
+            exit(1);
+        }
+        //The main thread may wait for I/O or migrate, so worker 0 needs an
+        //idle context of its own.
+        main_worker->idle_stack = StackAllocator::getInstance().allocate(STACK_SIZE);
+        context_make(&main_worker->idle_context, main_worker->idle_stack.base,
+                     main_worker->idle_stack.size, worker_idle_entry, main_worker);
+        if (is_preemptive) {
+            //A single worker may use the virtual timer, which counts the
+            //executing time of the process, every other source is per worker.
+            if (worker_count == 1 && timer_source == UTHREAD_TIMER_VIRTUAL) {
+                init_itimer(quantum);
+            } else {
+                init_itimer(0);
+                init_worker_timer(main_worker, quantum);
+            }
+        }
+        if (worker_count > 1) {
+            //The new kernel threads inherit the blocked SIGVTALRM and wait for
+            //the scheduler lock before looking for work.
+            for (int i = 1; i < worker_count; i++) {
+                if (pthread_create(&workers[i]->thread, NULL, worker_main, workers[i]) != 0) {
+                    SYSCALL_FAIL("pthread_create error.");
+                    free_all_memory();
+                    exit(1);
+                }
+            }
+        }
         increment_overall_quantum_count();
-        running_thread->increment_quantum_count();
+        main_thread->increment_quantum_count();
         UNBLOCK_SIGNALS();
         return SUCCESS;
     }
@@ -52,26 +197,241 @@ int UThreadsManager::uthread_init(int quantum) {
 }
 
 int UThreadsManager::uthread_spawn(thread_entry_point entry_point) {
+    return uthread_spawn(entry_point, default_stack_size);
+}
+
+int UThreadsManager::uthread_spawn_handle(thread_entry_point entry_point) {
+    return uthread_spawn(entry_point, default_stack_size, true);
+}
+
+int UThreadsManager::uthread_create(void *(*routine)(void *), void *arg) {
+    GUARD(
+            routine == nullptr,
+            UTHREADS_FAIL("routine must be not null")
+    );
+    return spawn(nullptr, routine, arg, default_stack_size, false);
+}
+
+int UThreadsManager::uthread_join(int tid, void **result) {
+    BLOCK_SIGNALS();
+    void *value;
+    //Already terminated
+    int exited_tid = threads.take_result(tid, &value);
+    if (exited_tid == FAILURE) {
+        UThread *thread = threads.get(tid);
+        UThread *running_thread = current_thread();
+        GUARD_BLOCKED(
+                thread == nullptr,
+                UTHREADS_FAIL("Can't join a non-existing thread.")
+        );
+        //A chain of joins that leads back to the calling thread would close
+        //a cycle, no thread of it could ever terminate. Joins never form a
+        //cycle, so the chain ends.
+        const UThread *link = thread;
+        while (link != nullptr && link != running_thread)
+            link = link->get_join_target();
+        GUARD_BLOCKED(
+                link == running_thread || thread->get_tid() == MAIN_THREAD_ID,
+                UTHREADS_FAIL("Joining this thread would never return.")
+        );
+        GUARD_BLOCKED(
+                !thread->get_joinable() || thread->is_joined(),
+                UTHREADS_FAIL("Can't join a detached or already joined thread.")
+        );
+        //Returns once the thread terminated and handed over its exit value
+        running_thread->join(thread);
+        handle_waiting_threads();
+        jmp_to_next_thread();
+        value = running_thread->get_join_result();
+    } else
+        release_exited(exited_tid);
+    if (result != nullptr)
+        *result = value;
+    UNBLOCK_SIGNALS();
+    return SUCCESS;
+}
+
+int UThreadsManager::uthread_detach(int tid) {
     BLOCK_SIGNALS();
-    // check that we can still create thread and didn't pass the limit MAX_THREAD_NUM
+    void *value;
+    int exited_tid = threads.take_result(tid, &value);
+    if (exited_tid != FAILURE) {
+        release_exited(exited_tid);
+        UNBLOCK_SIGNALS();
+        return SUCCESS;
+    }
+    UThread *thread = threads.get(tid);
+    GUARD_BLOCKED(
+            thread == nullptr,
+            UTHREADS_FAIL("Can't detach a non-existing thread.")
+    );
+    GUARD_BLOCKED(
+            !thread->get_joinable() || thread->is_joined(),
+            UTHREADS_FAIL("Can't detach a detached or already joined thread.")
+    );
+    thread->set_joinable(false);
+    UNBLOCK_SIGNALS();
+    return SUCCESS;
+}
+
+int UThreadsManager::uthread_spawn(thread_entry_point entry_point, size_t stack_size,
+                                   bool as_handle) {
     GUARD(
             entry_point == nullptr,
             UTHREADS_FAIL("entry point must be not null")
     );
+    return spawn(entry_point, nullptr, nullptr, stack_size, as_handle);
+}
 
-    GUARD(
+int UThreadsManager::spawn(thread_entry_point entry_point, void *(*routine)(void *),
+                           void *arg, size_t stack_size, bool as_handle) {
+    BLOCK_SIGNALS();
+    // check that we can still create thread and didn't pass the thread limit
+    GUARD_BLOCKED(
+            stack_size == 0,
+            UTHREADS_FAIL("stack size must be a positive integer")
+    );
+
+    GUARD_BLOCKED(
             available_thread_ids.is_empty(),
             UTHREADS_FAIL("can't create new threads as limit has been reached")
     );
+    //Make sure the stack allocation doesn't fail
+    try {
+        int new_tid = create_thread(entry_point, routine, arg, stack_size)->get_tid();
+        int res = as_handle ? threads.get_handle(new_tid) : new_tid;
+        UNBLOCK_SIGNALS();
+        return res;
+    }
+    catch (std::bad_alloc &e) {
+        SYSCALL_FAIL("bad alloc");
+        free_all_memory();
+        UNBLOCK_SIGNALS();
+        exit(1);
+    }
+    UNBLOCK_SIGNALS();
+}
+
+UThread *UThreadsManager::create_thread(thread_entry_point entry_point, void *(*routine)(void *),
+                                        void *arg, size_t stack_size) {
     //get lowest pid available
-    int new_tid = available_thread_ids.pop();
-    //Make sure std::make_shared doesn't fail
+    int new_tid = available_thread_ids.allocate();
+    SharedStack &shared_stack = SharedStack::getInstance();
+    //In the shared stack mode only a thread with a stack size of its own
+    //gets a stack of its own
+    bool shares_stack = shared_stack.is_enabled() && stack_size == default_stack_size;
+    UThread *new_thread;
+    try {
+        Stack stack = shares_stack ? shared_stack.get_stack()
+                                   : StackAllocator::getInstance().allocate(stack_size);
+        new_thread = threads.add(new_tid, entry_point, stack);
+    }
+    catch (std::bad_alloc &e) {
+        available_thread_ids.release(new_tid);
+        throw;
+    }
+    if (routine != nullptr) {
+        new_thread->set_routine(routine, arg);
+        new_thread->set_joinable(true);
+    }
+    if (is_adaptive)
+        new_thread->set_slice(UTHREAD_INITIAL_SLICE, false);
+    current_worker()->ready_threads->push_back(new_thread);
+    wake_parked_worker(current_worker());
+    trace(UTHREAD_TRACE_SPAWN, new_tid);
+    return new_thread;
+}
+
+int UThreadsManager::uthread_spawn_batch(void *(*routine)(void *), void *const args[], int n,
+                                         int tids[]) {
+    GUARD(
+            routine == nullptr || tids == nullptr,
+            UTHREADS_FAIL("routine and tids must be not null")
+    );
+    GUARD(n <= 0, UTHREADS_FAIL("Can only create a positive amount of threads."));
+    BLOCK_SIGNALS();
+    GUARD_BLOCKED(
+            available_thread_ids.get_free_count() < n,
+            UTHREADS_FAIL("can't create new threads as limit has been reached")
+    );
+    try {
+        for (int i = 0; i < n; i++)
+            tids[i] = create_thread(nullptr, routine, args != nullptr ? args[i] : nullptr,
+                                    default_stack_size)->get_tid();
+    }
+    catch (std::bad_alloc &e) {
+        SYSCALL_FAIL("bad alloc");
+        free_all_memory();
+        UNBLOCK_SIGNALS();
+        exit(1);
+    }
+    UNBLOCK_SIGNALS();
+    return SUCCESS;
+}
+
+int UThreadsManager::uthread_pool_submit(void *(*routine)(void *), void *arg) {
+    GUARD(
+            routine == nullptr,
+            UTHREADS_FAIL("routine must be not null")
+    );
+    BLOCK_SIGNALS();
     try {
-        thread_ptr new_thread = std::make_shared<UThread>(new_tid, entry_point);
-        thread_map.insert({new_tid, new_thread});
-        threads_scheduler.push_back(thread_map.at(new_tid));
+        pool_tasks.push_back(PoolTask{routine, arg});
+        if (!idle_pool_threads.is_empty()) {
+            UThread *thread = idle_pool_threads.front();
+            if (stop_waiting(thread))
+                make_ready(thread);
+        } else if (pool_thread_count < pool_limit && !available_thread_ids.is_empty()) {
+            //Runs queued tasks until there are none, then waits for more
+            UThread *thread = create_thread(nullptr, pool_thread_main, nullptr, default_stack_size);
+            thread->set_joinable(false);
+            pool_thread_count += 1;
+        }
+        //Otherwise a busy pool thread takes the task once it's done
+    }
+    catch (std::bad_alloc &e) {
+        SYSCALL_FAIL("bad alloc");
+        free_all_memory();
         UNBLOCK_SIGNALS();
-        return new_tid;
+        exit(1);
+    }
+    UNBLOCK_SIGNALS();
+    return SUCCESS;
+}
+
+int UThreadsManager::uthread_task_post(uthread_task_node_t *node) {
+    GUARD(
+            node == nullptr || node->run == nullptr,
+            UTHREADS_FAIL("Can't post a task without a function.")
+    );
+    BLOCK_SIGNALS();
+    GUARD_BLOCKED(
+            start_task_runners() == FAILURE,
+            UTHREADS_FAIL("can't create the task runners as the thread limit has been reached")
+    );
+    post_task(node);
+    UNBLOCK_SIGNALS();
+    return SUCCESS;
+}
+
+int UThreadsManager::uthread_task_sleep_ns(uthread_task_node_t *node, long long nsecs) {
+    GUARD(
+            node == nullptr || node->run == nullptr,
+            UTHREADS_FAIL("Can't put a task without a function to sleep.")
+    );
+    GUARD(
+            nsecs <= 0,
+            UTHREADS_FAIL("Can only put to sleep for a positive amount of nanoseconds.")
+    );
+    BLOCK_SIGNALS();
+    GUARD_BLOCKED(
+            start_task_runners() == FAILURE,
+            UTHREADS_FAIL("can't create the task runners as the thread limit has been reached")
+    );
+    node->wake_time = UThread::clock_ns() + (unsigned long long) nsecs;
+    try {
+        //May allocate, unlike the timer that pops the heap
+        sleeping_tasks.push_back(node);
     }
     catch (std::bad_alloc &e) {
         SYSCALL_FAIL("bad alloc");
@@ -79,207 +439,1275 @@ int UThreadsManager::uthread_spawn(thread_entry_point entry_point) {
         UNBLOCK_SIGNALS();
         exit(1);
     }
+    std::push_heap(sleeping_tasks.begin(), sleeping_tasks.end(), wakes_later);
+    UNBLOCK_SIGNALS();
+    return SUCCESS;
+}
+
+int UThreadsManager::uthread_task_join(uthread_task_node_t *node, int tid) {
+    GUARD(
+            node == nullptr || node->run == nullptr,
+            UTHREADS_FAIL("Can't join with a task without a function.")
+    );
+    BLOCK_SIGNALS();
+    GUARD_BLOCKED(
+            start_task_runners() == FAILURE,
+            UTHREADS_FAIL("can't create the task runners as the thread limit has been reached")
+    );
+    //Already terminated
+    int exited_tid = threads.take_result(tid, &node->result);
+    if (exited_tid != FAILURE) {
+        release_exited(exited_tid);
+        post_task(node);
+        UNBLOCK_SIGNALS();
+        return SUCCESS;
+    }
+    UThread *thread = threads.get(tid);
+    GUARD_BLOCKED(
+            thread == nullptr,
+            UTHREADS_FAIL("Can't join a non-existing thread.")
+    );
+    GUARD_BLOCKED(
+            thread->get_tid() == MAIN_THREAD_ID || thread->get_routine() == task_runner_main,
+            UTHREADS_FAIL("Joining this thread would never return.")
+    );
+    GUARD_BLOCKED(
+            !thread->get_joinable() || thread->is_joined(),
+            UTHREADS_FAIL("Can't join a detached or already joined thread.")
+    );
+    thread->set_join_task(node);
+    UNBLOCK_SIGNALS();
+    return SUCCESS;
+}
+
+int UThreadsManager::start_task_runners() {
+    while (task_runner_count < (int) workers.size() && !available_thread_ids.is_empty()) {
+        try {
+            UThread *thread = create_thread(nullptr, task_runner_main, nullptr,
+                                            default_stack_size);
+            thread->set_joinable(false);
+        }
+        catch (std::bad_alloc &e) {
+            //Fewer runners only make the tasks run on fewer workers
+            break;
+        }
+        task_runner_count += 1;
+    }
+    return task_runner_count > 0 ? SUCCESS : FAILURE;
+}
+
+void UThreadsManager::post_task(uthread_task_node_t *node) {
+    node->next = nullptr;
+    if (ready_tasks_tail == nullptr)
+        ready_tasks_head = node;
+    else
+        ready_tasks_tail->next = node;
+    ready_tasks_tail = node;
+    ready_task_count += 1;
+    if (!idle_task_runners.is_empty()) {
+        UThread *thread = idle_task_runners.front();
+        if (stop_waiting(thread))
+            make_ready(thread);
+    }
+}
+
+void UThreadsManager::handle_sleeping_tasks(unsigned long long now) {
+    while (!sleeping_tasks.empty() && sleeping_tasks.front()->wake_time <= now) {
+        std::pop_heap(sleeping_tasks.begin(), sleeping_tasks.end(), wakes_later);
+        uthread_task_node_t *node = sleeping_tasks.back();
+        sleeping_tasks.pop_back();
+        post_task(node);
+    }
+}
+
+bool UThreadsManager::wakes_later(const uthread_task_node_t *a, const uthread_task_node_t *b) {
+    return a->wake_time > b->wake_time;
+}
+
+void *UThreadsManager::task_runner_main(void *arg) {
+    UThreadsManager &instance = getInstance();
+    while (true) {
+        BLOCK_SIGNALS();
+        while (instance.ready_tasks_head == nullptr)
+            instance.wait_on(&instance.idle_task_runners);
+        //Takes its share of the queued nodes at once, so a node costs a
+        //single critical section, the one that posted it
+        int count = std::max(instance.ready_task_count / instance.task_runner_count, 1);
+        uthread_task_node_t *first = instance.ready_tasks_head;
+        uthread_task_node_t *last = first;
+        for (int i = 1; i < count; i++)
+            last = last->next;
+        instance.ready_tasks_head = last->next;
+        if (instance.ready_tasks_head == nullptr)
+            instance.ready_tasks_tail = nullptr;
+        instance.ready_task_count -= count;
+        last->next = nullptr;
+        UNBLOCK_SIGNALS();
+        while (first != nullptr) {
+            uthread_task_node_t *node = first;
+            first = first->next;
+            //May post the node again, or free it
+            node->run(node);
+        }
+    }
+    return arg;
+}
+
+void *UThreadsManager::pool_thread_main(void *arg) {
+    UThreadsManager &instance = getInstance();
+    while (true) {
+        BLOCK_SIGNALS();
+        //Returns once a task was submitted, another pool thread may have
+        //taken it by then
+        while (instance.pool_tasks.empty())
+            instance.wait_on(&instance.idle_pool_threads);
+        PoolTask task = instance.pool_tasks.front();
+        instance.pool_tasks.pop_front();
+        UNBLOCK_SIGNALS();
+        task.routine(task.arg);
+    }
+    return arg;
+}
+
+int UThreadsManager::uthread_get_handle(int tid) {
+    //Without the scheduler lock unless the thread changed meanwhile
+    unsigned int generation;
+    UThread *found = threads.find(tid, generation);
+    if (found != nullptr && threads.is_unchanged(tid, found, generation))
+        return (int) (generation << UTHREAD_TID_BITS) | (tid & UTHREAD_TID_MASK);
+    BLOCK_SIGNALS();
+    UThread *thread = threads.get(tid);
+    GUARD_BLOCKED(
+            thread == nullptr,
+            UTHREADS_FAIL("Can't get the handle of non-existing thread")
+    );
+    int handle = threads.get_handle(thread->get_tid());
     UNBLOCK_SIGNALS();
+    return handle;
 }
 
 int UThreadsManager::uthread_terminate(int tid) {
+    return terminate(tid, nullptr);
+}
+
+void UThreadsManager::uthread_exit(void *result) {
+    terminate(current_thread()->get_tid(), result);
+}
+
+int UThreadsManager::terminate(int tid, void *result) {
+    run_key_destructors(tid);
     BLOCK_SIGNALS();
     // if not tid exists return FAILURE
-    GUARD(
-            this->thread_map.find(tid) == this->thread_map.end(),
+    UThread *thread = threads.get(tid);
+    GUARD_BLOCKED(
+            thread == nullptr,
             UTHREADS_FAIL("Can't terminate a none existing thread.")
     );
+    //The tid may come tagged, see uthread_get_handle
+    tid = thread->get_tid();
+    trace(UTHREAD_TRACE_TERMINATE, tid);
     // if tid==0 release all memory and exit(0)
     if (tid == 0) {
         free_all_memory();
-        UNBLOCK_SIGNALS();
+        //Stays in the critical section, no worker may schedule while exiting
         exit(0);
     }
-    //return tid number to the available pool of values
-    if (tid != running_thread->get_tid()) {
-        threads_scheduler.remove(thread_map.find(tid)->second);
-        //Remove from the sleeping there if it's there.
-        for (auto &thread_ptr: this->sleeping_threads) {
-            if (thread_ptr->get_tid() == tid) {
-                this->sleeping_threads.erase(thread_ptr);
-                break;
-            }
-        }
+    if (thread->get_queue() != nullptr)
+        thread->get_queue()->remove(thread);
+    //Remove from the sleeping threads if it's there.
+    sleeping_threads.remove(thread);
+    timed_sleepers.remove(thread);
+    io_reactor.remove_waiter(thread);
+    if (thread->get_routine() == pool_thread_main)
+        pool_thread_count -= 1;
+    if (thread->get_routine() == task_runner_main)
+        task_runner_count -= 1;
+    //The exit value goes straight to a waiting joiner, otherwise a joinable
+    //thread keeps it, and its tid, until it's joined.
+    UThread *joiner = thread->leave_joins(result);
+    uthread_task_node_t *join_task = thread->get_join_task();
+    if (join_task != nullptr) {
+        thread->set_join_task(nullptr);
+        join_task->result = result;
+        post_task(join_task);
     }
-    thread_map.erase(tid);
-    available_thread_ids.push(tid);
-    if (tid == running_thread->get_tid()) {
+    bool keeps_result = joiner == nullptr && join_task == nullptr && thread->get_joinable();
+    bool wakes_joiner = joiner != nullptr && stop_waiting(joiner);
+    Worker *worker = running_worker(thread);
+    if (worker == nullptr) {
+        threads.remove(tid);
+        if (keeps_result)
+            threads.set_result(tid, result);
+        else
+            //return tid number to the available pool of values
+            available_thread_ids.release(tid);
+        if (wakes_joiner)
+            make_ready(joiner);
         UNBLOCK_SIGNALS();
-        handle_sleeping_threads();
-        jmp_to_next_thread();
+        return SUCCESS;
     }
+    //The thread still runs on its stack, it's reclaimed together with its tid
+    //once the worker switched away from it
+    thread->state = TERMINATED;
+    threads.retire(tid);
+    if (keeps_result)
+        threads.set_result(tid, result);
+    if (worker == current_worker()) {
+        //Never returns, nothing will switch back to a terminated thread. The
+        //joiner runs right away.
+        handle_waiting_threads();
+        jmp_to_next_thread(wakes_joiner ? joiner : nullptr);
+    }
+    if (wakes_joiner)
+        make_ready(joiner);
+    kick(worker);
     UNBLOCK_SIGNALS();
     return SUCCESS;
 }
 
 int UThreadsManager::uthread_block(int tid) {
     BLOCK_SIGNALS();
-    GUARD(
-            thread_map.count(tid) <= 0,
+    UThread *thread = threads.get(tid);
+    GUARD_BLOCKED(
+            thread == nullptr,
             UTHREADS_FAIL("Can't block non-existing thread")
     );
-    GUARD(
+    tid = thread->get_tid();
+    GUARD_BLOCKED(
             tid == 0,
             UTHREADS_FAIL("Can't block main thread")
     );
-    thread_map.at(tid)->block();
-    if (tid == uthread_get_tid()) {
-        //About to block itself so save current state
-        int ret_val = sigsetjmp(running_thread->env, 1);
-        if (ret_val == 1) {
-            return SUCCESS;
-        }
-        handle_sleeping_threads();
+    thread->block(current_worker()->clock_ns);
+    trace(UTHREAD_TRACE_BLOCK, tid);
+    Worker *worker = running_worker(thread);
+    if (worker == current_worker()) {
+        //Returns once the thread was resumed and scheduled again
+        handle_waiting_threads();
         jmp_to_next_thread();
-    } else
-        threads_scheduler.remove(thread_map.at(tid));
+    } else if (worker != nullptr) {
+        //Running on another worker, it stops at that worker's next switch
+        kick(worker);
+    } else if (!thread->is_waiting_sync && thread->get_queue() != nullptr)
+        //Only a READY thread leaves its queue, a waiting one keeps its place
+        thread->get_queue()->remove(thread);
     UNBLOCK_SIGNALS();
     return SUCCESS;
 }
 
 int UThreadsManager::uthread_resume(int tid) {
     BLOCK_SIGNALS();
-    GUARD(
-            thread_map.count(tid) <= 0,
+    UThread *selected_thread = threads.get(tid);
+    GUARD_BLOCKED(
+            selected_thread == nullptr,
             UTHREADS_FAIL("Can't resume non-existing thread")
     );
+    tid = selected_thread->get_tid();
     //they said in the forum that there is no test for this, but it doesn't hurt
     // to leave it here anyway
-    GUARD(
+    GUARD_BLOCKED(
             tid == MAIN_THREAD_ID,
             UTHREADS_FAIL("Can't resume main thread.")
     );
-    thread_ptr selected_thread = thread_map.at(tid);
-    if (selected_thread->state == BLOCKED) {
-        selected_thread->is_blocked = false;
-        if (!selected_thread->is_sleeping) {
-            selected_thread->state = READY;
-            threads_scheduler.push_back(selected_thread);
-        }
-    }
+    //A kernel thread that isn't a worker has no READY threads list, and no
+    //worker may be awake to notice the thread, so the scheduler resumes it
+    if (current_worker() == nullptr)
+        wakeups.push(tid);
+    else
+        resume(selected_thread);
     UNBLOCK_SIGNALS();
     return SUCCESS;
 }
 
+int UThreadsManager::uthread_wake(int tid) {
+    //No lock, the caller may have interrupted its holder
+    return wakeups.push(tid) < 0 ? FAILURE : SUCCESS;
+}
+
+void UThreadsManager::resume(UThread *thread) {
+    if (thread->state != BLOCKED)
+        return;
+    thread->is_blocked = false;
+    trace(UTHREAD_TRACE_RESUME, thread->get_tid());
+    if (thread->is_sleeping || thread->is_waiting_io || thread->is_waiting_sync)
+        return;
+    if (running_worker(thread) != nullptr) {
+        //Blocked by another thread but not switched out yet
+        thread->state = RUNNING;
+    } else
+        make_ready(thread);
+}
+
 int UThreadsManager::uthread_sleep(int num_quantums) {
     BLOCK_SIGNALS();
-    GUARD(
+    GUARD_BLOCKED(
             num_quantums <= 0,
             UTHREADS_FAIL("Can only put to sleep to a positive amount of "
                           "quantums.")
     );
-    GUARD(
+    UThread *running_thread = current_worker()->running_thread;
+    GUARD_BLOCKED(
             running_thread->get_tid() == MAIN_THREAD_ID,
             UTHREADS_FAIL("Can't put main thread to sleep.")
     );
-    //The "plus 1" is because of the "handle_sleeping_threads" after.
-    running_thread->sleep(num_quantums + 1);
-    sleeping_threads.insert(running_thread);
-    //Saves the thread context before putting it to sleep
-    int ret_val = sigsetjmp(running_thread->env, 1);
-    if (ret_val == 1) {
-        return SUCCESS;
-    }
-    handle_sleeping_threads();
+    //The quantums that follow the current one are counted, the thread is
+    //READY again when quantum number "current + num_quantums + 1" starts.
+    running_thread->sleep_until(overall_quantum_count + num_quantums);
+    sleeping_threads.push(running_thread);
+    handle_waiting_threads();
     jmp_to_next_thread();
     UNBLOCK_SIGNALS();
     return SUCCESS;
 }
 
-int UThreadsManager::uthread_get_tid() {
-    return running_thread->get_tid();
-}
-
-int UThreadsManager::uthread_get_total_quantums() { return overall_quantum_count; }
-
-int UThreadsManager::uthread_get_quantums(int tid) {
-    GUARD(
-            thread_map.count(tid) <= 0,
-            UTHREADS_FAIL("Can't get quantums count for non-existing thread")
+int UThreadsManager::uthread_sleep_ns(long long nsecs) {
+    BLOCK_SIGNALS();
+    GUARD_BLOCKED(
+            nsecs <= 0,
+            UTHREADS_FAIL("Can only put to sleep for a positive amount of "
+                          "nanoseconds.")
     );
-    return thread_map.at(tid)->get_quantum_count();
+    //The main thread may sleep too, its worker idles meanwhile if there is
+    //nothing else to run
+    UThread *running_thread = current_worker()->running_thread;
+    running_thread->sleep_until_time(UThread::clock_ns() + (unsigned long long) nsecs);
+    timed_sleepers.push(running_thread);
+    handle_waiting_threads();
+    jmp_to_next_thread();
+    UNBLOCK_SIGNALS();
+    return SUCCESS;
 }
 
-
-/*
- * internal funcitons
- * */
-UThreadsManager::UThreadsManager() {}
-
-void UThreadsManager::free_all_memory() {
-    thread_map.clear();
-    threads_scheduler.clear();
-    available_thread_ids.clear();
-    running_thread.reset();
+int UThreadsManager::uthread_yield() {
+    BLOCK_SIGNALS();
+    //Does what the timer does when a quantum ends
+    handle_waiting_threads();
+    switch_threads();
+    UNBLOCK_SIGNALS();
+    return SUCCESS;
 }
 
-void UThreadsManager::increment_overall_quantum_count() {
-    overall_quantum_count += 1;
+int UThreadsManager::uthread_set_priority(int tid, int priority) {
+    BLOCK_SIGNALS();
+    UThread *thread = threads.get(tid);
+    GUARD_BLOCKED(
+            thread == nullptr,
+            UTHREADS_FAIL("Can't set the priority of non-existing thread")
+    );
+    GUARD_BLOCKED(
+            priority < 0 || priority >= UTHREAD_PRIORITY_LEVELS,
+            UTHREADS_FAIL("Priority must be between 0 and UTHREAD_PRIORITY_LEVELS - 1.")
+    );
+    update_schedule(thread, [priority](UThread *thread) { thread->set_priority(priority); });
+    UNBLOCK_SIGNALS();
+    return SUCCESS;
 }
 
-void UThreadsManager::switch_threads() {
+int UThreadsManager::uthread_set_weight(int tid, int weight) {
     BLOCK_SIGNALS();
-    //Only main thread exists
-    if (threads_scheduler.is_empty()) {
-        running_thread->increment_quantum_count();
-        increment_overall_quantum_count();
-        UNBLOCK_SIGNALS();
-        return;
-    }
-    running_thread->state = READY;
-    threads_scheduler.push_back(running_thread);
-    bool did_jut_save_bookmark = 0 == sigsetjmp(running_thread->env, MASK_KEEP);
-    if (did_jut_save_bookmark) {
-        jmp_to_next_thread();
-    }
+    UThread *thread = threads.get(tid);
+    GUARD_BLOCKED(
+            thread == nullptr,
+            UTHREADS_FAIL("Can't set the weight of non-existing thread")
+    );
+    GUARD_BLOCKED(
+            weight < UTHREAD_MIN_WEIGHT || weight > UTHREAD_MAX_WEIGHT,
+            UTHREADS_FAIL("Weight must be between UTHREAD_MIN_WEIGHT and UTHREAD_MAX_WEIGHT.")
+    );
+    update_schedule(thread, [weight](UThread *thread) { thread->set_weight(weight); });
+    UNBLOCK_SIGNALS();
+    return SUCCESS;
 }
 
-
-/*
- * static functions
- * */
-int UThreadsManager::init(int quantum) {
-    if (UThreadsManager::getInstance().uthread_init(quantum) == FAILURE)
-        return FAILURE;
-    return init_itimer(quantum);
+int UThreadsManager::uthread_set_quantum(int tid, int quantum_usecs) {
+    BLOCK_SIGNALS();
+    UThread *thread = threads.get(tid);
+    GUARD_BLOCKED(
+            thread == nullptr,
+            UTHREADS_FAIL("Can't set the quantum of non-existing thread")
+    );
+    GUARD_BLOCKED(
+            quantum_usecs < 0,
+            UTHREADS_FAIL("Quantum must be a non negative integer.")
+    );
+    if (quantum_usecs == 0) {
+        thread->set_slice(is_adaptive ? UTHREAD_INITIAL_SLICE : 1, false);
+    } else {
+        //Cooperative mode has no quantums to count, the slice is never used
+        int quantum = std::max(quantum_length, 1);
+        thread->set_slice((int) (((long long) quantum_usecs + quantum - 1) / quantum), true);
+    }
+    UNBLOCK_SIGNALS();
+    return SUCCESS;
 }
 
-UThreadsManager &UThreadsManager::getInstance() {
-    static UThreadsManager instance;
-    return instance;
+int UThreadsManager::uthread_stats(uthread_stats_t *stats) {
+    GUARD(stats == nullptr, UTHREADS_FAIL("Can't copy the counters to null."));
+    //Racy reads of counters the workers keep updating, fine for statistics
+    *stats = {};
+    for (const Worker *worker: workers) {
+        const uthread_stats_t &counters = worker->stats;
+        stats->switches += counters.switches;
+        stats->timer_ticks += counters.timer_ticks;
+        stats->timer_handler_ns += counters.timer_handler_ns;
+        stats->timer_handler_max_ns = std::max(stats->timer_handler_max_ns, counters.timer_handler_max_ns);
+        for (int bucket = 0; bucket < UTHREAD_RUN_QUEUE_BUCKETS; bucket++)
+            stats->run_queue_depth[bucket] += counters.run_queue_depth[bucket];
+    }
+    return SUCCESS;
 }
 
-void UThreadsManager::timer_handler(int sig) {
+int UThreadsManager::uthread_thread_stats(int tid, uthread_thread_stats_t *stats) {
+    GUARD(stats == nullptr, UTHREADS_FAIL("Can't copy the counters to null."));
     BLOCK_SIGNALS();
-    //Wake threads that finished their "sleep"
-    handle_sleeping_threads();
-    reset_timer(getInstance().quantum_length);
+    UThread *thread = threads.get(tid);
+    GUARD_BLOCKED(
+            thread == nullptr,
+            UTHREADS_FAIL("Can't get the counters of non-existing thread")
+    );
+    *stats = thread->get_stats(UThread::clock_ns());
     UNBLOCK_SIGNALS();
-    //Switch threads according to Round-Robin algorithm.
-    getInstance().switch_threads();
+    return SUCCESS;
 }
 
-int UThreadsManager::init_itimer(int quantum) {
-    struct sigaction sa = {nullptr};
-
-    // Install timer_handler as the signal handler for SIGVTALRM.
-    sa.sa_handler = timer_handler;
+int UThreadsManager::uthread_trace_enable(int on) {
+    GUARD(
+            !event_trace.set_enabled(on != 0),
+            UTHREADS_FAIL("The trace has no buffer, see trace_events.")
+    );
+    return SUCCESS;
+}
+
+int UThreadsManager::uthread_trace_dump(int fd) {
+    try {
+        int count = event_trace.dump(fd);
+        GUARD(count < 0, SYSCALL_FAIL("write error."));
+        return count;
+    }
+    catch (std::bad_alloc &e) {
+        SYSCALL_FAIL("bad alloc");
+        return FAILURE;
+    }
+}
+
+int UThreadsManager::uthread_profile_enable(int on) {
+    GUARD(
+            on != 0 && !is_preemptive,
+            UTHREADS_FAIL("The profiler samples at preemptions, cooperative mode has none.")
+    );
+    GUARD(
+            !profiler.set_enabled(on != 0),
+            UTHREADS_FAIL("The profiler has no tables, see profile_stacks.")
+    );
+    return SUCCESS;
+}
+
+int UThreadsManager::uthread_profile_dump(int fd, int tid) {
+    std::vector<SampleProfiler::Count> counts;
+    //Copied inside the critical section and symbolized outside it, the stacks
+    //they refer to never change
+    BLOCK_SIGNALS();
+    try {
+        profiler.take_counts(tid == -1 ? -1 : tid & UTHREAD_TID_MASK, counts);
+    }
+    catch (std::bad_alloc &e) {
+        SYSCALL_FAIL("bad alloc");
+        UNBLOCK_SIGNALS();
+        return FAILURE;
+    }
+    UNBLOCK_SIGNALS();
+    GUARD(!profiler.write_folded(fd, counts), SYSCALL_FAIL("write error."));
+    return (int) counts.size();
+}
+
+int UThreadsManager::uthread_wait_fd(int fd, int events) {
+    BLOCK_SIGNALS();
+    GUARD_BLOCKED(
+            fd < 0 || (events & (EPOLLIN | EPOLLOUT)) == 0,
+            UTHREADS_FAIL("Can only wait for input or output of a valid file descriptor.")
+    );
+    UThread *running_thread = current_thread();
+    GUARD_BLOCKED(
+            io_reactor.add_waiter(running_thread, fd, events) < 0,
+            UTHREADS_FAIL("Can't wait for the file descriptor.")
+    );
+    //Returns once the descriptor is ready and the thread was scheduled again
+    handle_waiting_threads();
+    jmp_to_next_thread();
+    UNBLOCK_SIGNALS();
+    return SUCCESS;
+}
+
+ssize_t UThreadsManager::uthread_read(int fd, void *buf, size_t count) {
+    if (make_non_blocking(fd) < 0)
+        return FAILURE;
+    while (true) {
+        ssize_t res = read(fd, buf, count);
+        if (res >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+            return res;
+        if (errno != EINTR && uthread_wait_fd(fd, EPOLLIN) < 0)
+            return FAILURE;
+    }
+}
+
+ssize_t UThreadsManager::uthread_write(int fd, const void *buf, size_t count) {
+    if (make_non_blocking(fd) < 0)
+        return FAILURE;
+    while (true) {
+        ssize_t res = write(fd, buf, count);
+        if (res >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+            return res;
+        if (errno != EINTR && uthread_wait_fd(fd, EPOLLOUT) < 0)
+            return FAILURE;
+    }
+}
+
+int UThreadsManager::uthread_accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
+    if (make_non_blocking(sockfd) < 0)
+        return FAILURE;
+    while (true) {
+        int res = accept4(sockfd, addr, addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (res >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+            return res;
+        if (errno != EINTR && uthread_wait_fd(sockfd, EPOLLIN) < 0)
+            return FAILURE;
+    }
+}
+
+int UThreadsManager::uthread_mutex_init(uthread_mutex_t *mutex) {
+    GUARD(mutex == nullptr, UTHREADS_FAIL("Can't initialize a null mutex."));
+    new(mutex->opaque) MutexState();
+    return SUCCESS;
+}
+
+int UThreadsManager::uthread_mutex_destroy(uthread_mutex_t *mutex) {
+    GUARD(mutex == nullptr, UTHREADS_FAIL("Can't destroy a null mutex."));
+    MutexState *state = state_of(mutex);
+    GUARD(state->state.load() != 0, UTHREADS_FAIL("Can't destroy a locked mutex."));
+    state->waiters.reset();
+    return SUCCESS;
+}
+
+int UThreadsManager::uthread_mutex_lock(uthread_mutex_t *mutex) {
+    GUARD(mutex == nullptr, UTHREADS_FAIL("Can't lock a null mutex."));
+    MutexState *state = state_of(mutex);
+    int owner = current_thread()->get_tid() + 1;
+    //Uncontended, neither a system call nor the scheduler lock
+    int unlocked = 0;
+    if (state->state.compare_exchange_strong(unlocked, 1, std::memory_order_acquire)) {
+        state->owner.store(owner, std::memory_order_relaxed);
+        return SUCCESS;
+    }
+    GUARD(
+            state->owner.load(std::memory_order_relaxed) == owner,
+            UTHREADS_FAIL("The thread already owns the mutex.")
+    );
+    BLOCK_SIGNALS();
+    //Marks the mutex contended, so its owner unlocks it through here
+    if (state->state.exchange(2, std::memory_order_acquire) == 0) {
+        //Unlocked meanwhile
+        if (state->waiters.is_empty())
+            state->state.store(1, std::memory_order_relaxed);
+        state->owner.store(owner, std::memory_order_relaxed);
+    } else
+        //Returns once the owner handed the mutex over
+        wait_on(state->waiters.get());
+    UNBLOCK_SIGNALS();
+    return SUCCESS;
+}
+
+int UThreadsManager::uthread_mutex_trylock(uthread_mutex_t *mutex) {
+    if (mutex == nullptr)
+        return FAILURE;
+    MutexState *state = state_of(mutex);
+    int unlocked = 0;
+    if (!state->state.compare_exchange_strong(unlocked, 1, std::memory_order_acquire))
+        return FAILURE;
+    state->owner.store(current_thread()->get_tid() + 1, std::memory_order_relaxed);
+    return SUCCESS;
+}
+
+int UThreadsManager::uthread_mutex_unlock(uthread_mutex_t *mutex) {
+    GUARD(mutex == nullptr, UTHREADS_FAIL("Can't unlock a null mutex."));
+    MutexState *state = state_of(mutex);
+    GUARD(
+            state->owner.load(std::memory_order_relaxed) != current_thread()->get_tid() + 1,
+            UTHREADS_FAIL("The thread doesn't own the mutex.")
+    );
+    state->owner.store(0, std::memory_order_relaxed);
+    //Nobody waits, neither a system call nor the scheduler lock
+    int locked = 1;
+    if (state->state.compare_exchange_strong(locked, 0, std::memory_order_release))
+        return SUCCESS;
+    BLOCK_SIGNALS();
+    UThread *next_owner = release_mutex(state);
+    if (next_owner != nullptr)
+        hand_off(next_owner);
+    UNBLOCK_SIGNALS();
+    return SUCCESS;
+}
+
+int UThreadsManager::uthread_cond_init(uthread_cond_t *cond) {
+    GUARD(cond == nullptr, UTHREADS_FAIL("Can't initialize a null condition variable."));
+    new(cond->opaque) CondState();
+    return SUCCESS;
+}
+
+int UThreadsManager::uthread_cond_destroy(uthread_cond_t *cond) {
+    GUARD(cond == nullptr, UTHREADS_FAIL("Can't destroy a null condition variable."));
+    CondState *state = state_of(cond);
+    BLOCK_SIGNALS();
+    GUARD_BLOCKED(
+            !state->waiters.is_empty(),
+            UTHREADS_FAIL("Can't destroy a condition variable threads wait on.")
+    );
+    state->waiters.reset();
+    UNBLOCK_SIGNALS();
+    return SUCCESS;
+}
+
+int UThreadsManager::uthread_cond_wait(uthread_cond_t *cond, uthread_mutex_t *mutex) {
+    GUARD(
+            cond == nullptr || mutex == nullptr,
+            UTHREADS_FAIL("Can't wait on a null condition variable or mutex.")
+    );
+    CondState *state = state_of(cond);
+    MutexState *mutex_state = state_of(mutex);
+    GUARD(
+            mutex_state->owner.load(std::memory_order_relaxed) != current_thread()->get_tid() + 1,
+            UTHREADS_FAIL("The thread doesn't own the mutex.")
+    );
+    BLOCK_SIGNALS();
+    GUARD_BLOCKED(
+            state->mutex != nullptr && state->mutex != mutex_state && !state->waiters.is_empty(),
+            UTHREADS_FAIL("Threads wait on the condition variable with another mutex.")
+    );
+    state->mutex = mutex_state;
+    mutex_state->owner.store(0, std::memory_order_relaxed);
+    int locked = 1;
+    if (!mutex_state->state.compare_exchange_strong(locked, 0, std::memory_order_release)) {
+        UThread *next_owner = release_mutex(mutex_state);
+        if (next_owner != nullptr && stop_waiting(next_owner))
+            make_ready(next_owner);
+    }
+    //Returns once the thread was signaled and handed the mutex
+    wait_on(state->waiters.get());
+    UNBLOCK_SIGNALS();
+    return SUCCESS;
+}
+
+int UThreadsManager::uthread_cond_signal(uthread_cond_t *cond) {
+    GUARD(cond == nullptr, UTHREADS_FAIL("Can't signal a null condition variable."));
+    CondState *state = state_of(cond);
+    BLOCK_SIGNALS();
+    if (!state->waiters.is_empty())
+        requeue_on_mutex(state->waiters.get()->front(), state->mutex);
+    UNBLOCK_SIGNALS();
+    return SUCCESS;
+}
+
+int UThreadsManager::uthread_cond_broadcast(uthread_cond_t *cond) {
+    GUARD(cond == nullptr, UTHREADS_FAIL("Can't broadcast a null condition variable."));
+    CondState *state = state_of(cond);
+    BLOCK_SIGNALS();
+    while (!state->waiters.is_empty())
+        requeue_on_mutex(state->waiters.get()->front(), state->mutex);
+    UNBLOCK_SIGNALS();
+    return SUCCESS;
+}
+
+int UThreadsManager::uthread_sem_init(uthread_sem_t *sem, int count) {
+    GUARD(sem == nullptr, UTHREADS_FAIL("Can't initialize a null semaphore."));
+    GUARD(count < 0, UTHREADS_FAIL("The count of a semaphore must be a non negative integer."));
+    new(sem->opaque) SemState(count);
+    return SUCCESS;
+}
+
+int UThreadsManager::uthread_sem_destroy(uthread_sem_t *sem) {
+    GUARD(sem == nullptr, UTHREADS_FAIL("Can't destroy a null semaphore."));
+    SemState *state = state_of(sem);
+    BLOCK_SIGNALS();
+    GUARD_BLOCKED(
+            !state->waiters.is_empty(),
+            UTHREADS_FAIL("Can't destroy a semaphore threads wait on.")
+    );
+    state->waiters.reset();
+    UNBLOCK_SIGNALS();
+    return SUCCESS;
+}
+
+int UThreadsManager::uthread_sem_wait(uthread_sem_t *sem) {
+    GUARD(sem == nullptr, UTHREADS_FAIL("Can't wait on a null semaphore."));
+    SemState *state = state_of(sem);
+    //A unit is available, neither a system call nor the scheduler lock
+    int count = state->count.load(std::memory_order_relaxed);
+    while (count > 0)
+        if (state->count.compare_exchange_weak(count, count - 1, std::memory_order_acquire))
+            return SUCCESS;
+    BLOCK_SIGNALS();
+    //Announce the wait before looking again, a thread posting meanwhile
+    //either sees it or its unit is seen here
+    state->waiting.fetch_add(1);
+    count = state->count.load();
+    while (count > 0) {
+        if (state->count.compare_exchange_weak(count, count - 1)) {
+            state->waiting.fetch_sub(1);
+            UNBLOCK_SIGNALS();
+            return SUCCESS;
+        }
+    }
+    //Returns once a posting thread handed a unit over
+    wait_on(state->waiters.get());
+    UNBLOCK_SIGNALS();
+    return SUCCESS;
+}
+
+int UThreadsManager::uthread_sem_post(uthread_sem_t *sem) {
+    GUARD(sem == nullptr, UTHREADS_FAIL("Can't post a null semaphore."));
+    SemState *state = state_of(sem);
+    state->count.fetch_add(1);
+    //Nobody waits, neither a system call nor the scheduler lock
+    if (state->waiting.load() == 0)
+        return SUCCESS;
+    BLOCK_SIGNALS();
+    UThread *thread = nullptr;
+    if (state->waiters.is_empty()) {
+        //Only counted threads that were terminated while waiting
+        state->waiting.store(0);
+    } else {
+        //Take the unit back for the first waiting thread, unless another
+        //thread took it already
+        int count = state->count.load();
+        while (count > 0) {
+            if (state->count.compare_exchange_weak(count, count - 1)) {
+                thread = state->waiters.get()->front();
+                state->waiting.fetch_sub(1);
+                break;
+            }
+        }
+    }
+    if (thread != nullptr)
+        hand_off(thread);
+    UNBLOCK_SIGNALS();
+    return SUCCESS;
+}
+
+int UThreadsManager::uthread_key_create(uthread_key_t *key, void (*destructor)(void *)) {
+    GUARD(key == nullptr, UTHREADS_FAIL("Can't create a key in a null pointer."));
+    BLOCK_SIGNALS();
+    int slot = 0;
+    while (slot < UTHREAD_KEYS_MAX && is_key_used[slot])
+        slot++;
+    GUARD_BLOCKED(
+            slot == UTHREAD_KEYS_MAX,
+            UTHREADS_FAIL("can't create a new key as the limit has been reached")
+    );
+    is_key_used[slot] = true;
+    key_destructors[slot] = destructor;
+    key_count += 1;
+    *key = (int) (key_versions[slot] << KEY_SLOT_BITS) | slot;
+    UNBLOCK_SIGNALS();
+    return SUCCESS;
+}
+
+int UThreadsManager::uthread_key_delete(uthread_key_t key) {
+    BLOCK_SIGNALS();
+    int slot = KEY_SLOT(key);
+    GUARD_BLOCKED(
+            key < 0 || slot >= UTHREAD_KEYS_MAX || !is_key_used[slot] ||
+            key_versions[slot] != KEY_VERSION(key),
+            UTHREADS_FAIL("Can't delete a non-existing key.")
+    );
+    is_key_used[slot] = false;
+    key_destructors[slot] = nullptr;
+    key_versions[slot] = key_versions[slot] % MAX_KEY_VERSION + 1;
+    key_count -= 1;
+    UNBLOCK_SIGNALS();
+    return SUCCESS;
+}
+
+int UThreadsManager::uthread_setspecific(uthread_key_t key, const void *value) {
+    UThread *thread = current_thread();
+    int slot = KEY_SLOT(key);
+    GUARD(
+            thread == nullptr || key < 0 || slot >= UTHREAD_KEYS_MAX,
+            UTHREADS_FAIL("Can't set the value of a non-existing key.")
+    );
+    thread->set_specific(slot, KEY_VERSION(key), (void *) value);
+    return SUCCESS;
+}
+
+void *UThreadsManager::uthread_getspecific(uthread_key_t key) {
+    UThread *thread = current_thread();
+    int slot = KEY_SLOT(key);
+    if (thread == nullptr || key < 0 || slot >= UTHREAD_KEYS_MAX)
+        return nullptr;
+    return thread->get_specific(slot, KEY_VERSION(key));
+}
+
+void UThreadsManager::run_key_destructors(int tid) {
+    //Read without the lock, keys are only created before the threads that
+    //use them
+    if (key_count == 0)
+        return;
+    for (int round = 0; round < UTHREAD_DESTRUCTOR_ITERATIONS; round++) {
+        bool has_run = false;
+        int slot = 0;
+        //One value at a time, the lock is left for every destructor
+        while (true) {
+            BLOCK_SIGNALS();
+            UThread *thread = threads.get(tid);
+            if (thread == nullptr || thread->get_tid() == MAIN_THREAD_ID) {
+                UNBLOCK_SIGNALS();
+                return;
+            }
+            void (*destructor)(void *) = nullptr;
+            void *value = nullptr;
+            for (; slot < UTHREAD_KEYS_MAX && value == nullptr; slot++) {
+                destructor = key_destructors[slot];
+                if (is_key_used[slot] && destructor != nullptr)
+                    value = thread->take_specific(slot, key_versions[slot]);
+            }
+            UNBLOCK_SIGNALS();
+            if (value == nullptr)
+                break;
+            destructor(value);
+            has_run = true;
+        }
+        if (!has_run)
+            return;
+    }
+}
+
+int UThreadsManager::uthread_get_tid() {
+    return current_thread()->get_tid();
+}
+
+int UThreadsManager::uthread_get_total_quantums() { return overall_quantum_count; }
+
+int UThreadsManager::uthread_get_quantums(int tid) {
+    //Without the scheduler lock unless the thread changed meanwhile, the count
+    //itself is a racy read like the other counters
+    unsigned int generation;
+    UThread *found = threads.find(tid, generation);
+    if (found != nullptr) {
+        int quantums = found->get_quantum_count();
+        if (threads.is_unchanged(tid, found, generation))
+            return quantums;
+    }
+    BLOCK_SIGNALS();
+    UThread *thread = threads.get(tid);
+    GUARD_BLOCKED(
+            thread == nullptr,
+            UTHREADS_FAIL("Can't get quantums count for non-existing thread")
+    );
+    int quantums = thread->get_quantum_count();
+    UNBLOCK_SIGNALS();
+    return quantums;
+}
+
+
+/*
+ * internal funcitons
+ * */
+UThreadsManager::UThreadsManager() : max_threads(0), default_stack_size(STACK_SIZE),
+                                     timed_sleepers(true), pool_thread_count(0),
+                                     pool_limit(UTHREAD_DEFAULT_POOL_THREADS),
+                                     ready_tasks_head(nullptr), ready_tasks_tail(nullptr),
+                                     ready_task_count(0), task_runner_count(0), key_count(0),
+                                     main_stack{nullptr, 0} {
+    for (int slot = 0; slot < UTHREAD_KEYS_MAX; slot++) {
+        is_key_used[slot] = false;
+        //Version 0 is the one of slots never set, see UThread
+        key_versions[slot] = 1;
+        key_destructors[slot] = nullptr;
+    }
+}
+
+void UThreadsManager::free_all_memory() {
+    //The queues only link threads owned by the table, unlink them first.
+    //Running threads are kept, their stacks are still in use until exit.
+    for (Worker *worker: workers)
+        worker->ready_threads->clear();
+    sleeping_threads.clear();
+    timed_sleepers.clear();
+    idle_pool_threads.clear();
+    pool_tasks.clear();
+    pool_thread_count = 0;
+    idle_task_runners.clear();
+    ready_tasks_head = ready_tasks_tail = nullptr;
+    ready_task_count = 0;
+    task_runner_count = 0;
+    sleeping_tasks.clear();
+    io_reactor.clear();
+    for (int tid = 0; tid < max_threads; tid++) {
+        UThread *thread = threads.get(tid);
+        if (thread == nullptr)
+            continue;
+        if (running_worker(thread) == nullptr)
+            threads.remove(tid);
+        else
+            threads.retire(tid);
+    }
+    available_thread_ids.clear();
+    event_trace.release();
+    profiler.release();
+    //Kept while it's still in use, like the stacks of the running threads
+    UThread *running_thread = current_thread();
+    if (running_thread == nullptr || !running_thread->has_shared_stack())
+        SharedStack::getInstance().release();
+    StackAllocator::getInstance().clear();
+}
+
+void UThreadsManager::increment_overall_quantum_count() {
+    overall_quantum_count += 1;
+}
+
+void UThreadsManager::switch_threads() {
+    Worker *worker = current_worker();
+    UThread *running_thread = worker->running_thread;
+    //An idle worker looks for work in its own loop
+    if (running_thread == nullptr)
+        return;
+    bool is_tick = worker->tick_start != 0;
+    bool has_interactive_wakeup = worker->has_interactive_wakeup;
+    worker->has_interactive_wakeup = false;
+    //Blocked or terminated by another thread while running, just switch out
+    if (running_thread->state == RUNNING) {
+        //A tick in the middle of the slice, or only the running thread is
+        //READY on this worker
+        bool keeps_slice = is_tick && !has_interactive_wakeup &&
+                           running_thread->count_slice_quantum();
+        if (keeps_slice || worker->ready_threads->is_empty()) {
+            if (!keeps_slice)
+                running_thread->start_slice();
+            running_thread->increment_quantum_count();
+            increment_overall_quantum_count();
+            return;
+        }
+        running_thread->state = READY;
+        worker->ready_threads->push_back(running_thread);
+    }
+    jmp_to_next_thread();
+}
+
+Selector *UThreadsManager::create_selector() const {
+    switch (policy) {
+        case UTHREAD_POLICY_PRIORITY:
+            return new PrioritySelector();
+        case UTHREAD_POLICY_FAIR:
+            return new FairSelector(max_threads);
+        default:
+            return new RoundRobinSelector();
+    }
+}
+
+template<typename Update>
+void UThreadsManager::update_schedule(UThread *thread, Update update) {
+    //Wait queues are FIFO whatever the policy, only READY queues reorder
+    Selector *queue = thread->state == READY ? thread->get_queue() : nullptr;
+    if (queue != nullptr)
+        queue->remove(thread);
+    update(thread);
+    if (queue != nullptr)
+        queue->push_back(thread);
+}
+
+UThread *UThreadsManager::select_next_thread(Worker *worker) {
+    if (!worker->ready_threads->is_empty())
+        return worker->ready_threads->front();
+    //Steal the oldest READY thread of the next worker that has one
+    for (size_t i = 1; i < workers.size(); i++) {
+        Worker *victim = workers[(worker->id + i) % workers.size()];
+        if (!victim->ready_threads->is_empty())
+            return victim->ready_threads->front();
+    }
+    return nullptr;
+}
+
+Worker *UThreadsManager::running_worker(const UThread *thread) const {
+    for (Worker *worker: workers)
+        if (worker->running_thread == thread)
+            return worker;
+    return nullptr;
+}
+
+void UThreadsManager::kick(Worker *worker) {
+    //Without a timer the thread stops at its next yield
+    if (getInstance().is_preemptive)
+        pthread_kill(worker->thread, SIGVTALRM);
+}
+
+Worker *UThreadsManager::current_worker() {
+    //Keeps the compiler from treating this function as pure
+    asm volatile("");
+    return this_worker;
+}
+
+UThread *UThreadsManager::current_thread() {
+    asm volatile("");
+    return this_thread;
+}
+
+void UThreadsManager::trace(int type, int tid) {
+    if (!event_trace.is_enabled())
+        return;
+    Worker *worker = current_worker();
+    UThread *caller = current_thread();
+    event_trace.record(UThread::clock_ns(), type, tid, worker ? worker->id : -1,
+                       caller ? caller->get_tid() : -1);
+}
+
+int UThreadsManager::switch_out_reason(const UThread *thread, bool preempted) {
+    if (thread->state == TERMINATED)
+        return UTHREAD_TRACE_TERMINATED;
+    if (thread->is_blocked)
+        return UTHREAD_TRACE_BLOCKED;
+    if (thread->is_sleeping)
+        return UTHREAD_TRACE_SLEPT;
+    if (thread->is_waiting_sync || thread->is_waiting_io)
+        return UTHREAD_TRACE_WAITED;
+    return preempted ? UTHREAD_TRACE_PREEMPTED : UTHREAD_TRACE_YIELDED;
+}
+
+void UThreadsManager::on_thread_start() {
+    sigset_t sigset;
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGVTALRM);
+    reap(current_worker());
+    UNBLOCK_SIGNALS();
+}
+
+void UThreadsManager::worker_loop(Worker *worker) {
+    UThreadsManager &instance = getInstance();
+    sigset_t sigset;
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGVTALRM);
+    //The first switch to the idle context may come from a terminated thread
+    reap(worker);
+    unsigned long long idle_since = 0;
+    int quantum_count = -1;
+    while (true) {
+        //Returns once the worker has nothing to run anymore
+        instance.jmp_to_next_thread();
+        unsigned long long now = UThread::clock_ns();
+        worker->clock_ns = now;
+        //Threads ran since the last wait, the worker is idle from now on
+        if (instance.overall_quantum_count != quantum_count)
+            idle_since = now;
+        //Sleeps in the kernel until another worker makes a thread READY, a
+        //thread is woken, a descriptor is ready or a sleeper is due, no CPU
+        //is used while the process is idle.
+        long long timeout = instance.idle_timeout(worker, now, idle_since);
+        struct timespec idle_wait = {(time_t) (timeout / NSECS_PER_SEC), (long) (timeout % NSECS_PER_SEC)};
+        struct pollfd fds[3] = {{worker->park_fd, POLLIN, 0},
+                                {instance.wakeups.get_fd(), POLLIN, 0},
+                                {instance.io_reactor.get_fd(), POLLIN, 0}};
+        worker->is_parked = true;
+        //No quantum ends while nothing runs, jmp_to_next_thread arms it again
+        if (worker->is_timer_armed)
+            set_worker_timer(worker, 0);
+        UNBLOCK_SIGNALS();
+        int count = ppoll(fds, 3, timeout < 0 ? nullptr : &idle_wait, nullptr);
+        MASK_PREEMPTION(SIG_BLOCK);
+        instance.scheduler_lock.lock();
+        worker->is_parked = false;
+        //The threads woken below waited until now
+        worker->clock_ns = UThread::clock_ns();
+        eventfd_t value;
+        if (count > 0 && (fds[0].revents & POLLIN))
+            eventfd_read(worker->park_fd, &value);
+        //Also resets an eventfd that was left readable for nothing
+        if (count > 0 && (fds[1].revents & POLLIN))
+            instance.drain_wakeups();
+        //Nothing else may wake threads while every thread waits for I/O
+        handle_io_threads();
+        instance.count_idle_quantums(worker, worker->clock_ns, idle_since);
+        handle_sleeping_threads();
+        quantum_count = instance.overall_quantum_count;
+    }
+}
+
+bool UThreadsManager::counts_idle_quantums(const Worker *worker) const {
+    //Without a quantum length nothing but switches count quantums
+    if (worker->id != 0 || quantum_length <= 0 || sleeping_threads.is_empty())
+        return false;
+    //A worker that runs threads counts the quantums itself
+    for (const Worker *other: workers)
+        if (other->running_thread != nullptr)
+            return false;
+    return true;
+}
+
+void UThreadsManager::count_idle_quantums(const Worker *worker, unsigned long long now,
+                                          unsigned long long &idle_since) {
+    if (!counts_idle_quantums(worker))
+        return;
+    unsigned long long quantum_ns = (unsigned long long) quantum_length * 1000;
+    while (now - idle_since >= quantum_ns) {
+        increment_overall_quantum_count();
+        idle_since += quantum_ns;
+    }
+}
+
+long long UThreadsManager::idle_timeout(const Worker *worker, unsigned long long now,
+                                        unsigned long long idle_since) const {
+    //Threads made READY by other workers wake the worker through its eventfd
+    long long timeout = -1;
+    unsigned long long deadline = ULLONG_MAX;
+    if (!timed_sleepers.is_empty())
+        deadline = timed_sleepers.top()->get_wake_time();
+    if (!sleeping_tasks.empty())
+        deadline = std::min(deadline, sleeping_tasks.front()->wake_time);
+    if (counts_idle_quantums(worker))
+        deadline = std::min(deadline, idle_since + (unsigned long long) quantum_length * 1000);
+    if (deadline != ULLONG_MAX) {
+        long long left = deadline > now ? (long long) (deadline - now) : 0;
+        timeout = left;
+    }
+    return timeout;
+}
+
+void UThreadsManager::reap(Worker *worker) {
+    UThread *zombie = worker->zombie;
+    if (zombie == nullptr)
+        return;
+    worker->zombie = nullptr;
+    UThreadsManager &instance = getInstance();
+    int tid = zombie->get_tid();
+    instance.threads.reap(tid);
+    //Unless its exit value waits to be joined
+    if (!instance.threads.has_result(tid))
+        instance.available_thread_ids.release(tid);
+}
+
+void UThreadsManager::release_exited(int tid) {
+    if (!threads.is_constructed(tid))
+        available_thread_ids.release(tid);
+}
+
+void UThreadsManager::worker_idle_entry(void *arg) {
+    worker_loop((Worker *) arg);
+}
+
+void *UThreadsManager::worker_main(void *arg) {
+    Worker *worker = (Worker *) arg;
+    this_worker = worker;
+    worker->kernel_tid = gettid();
+    //The stack allocator is shared, so the setup is done under the lock too
+    getInstance().scheduler_lock.lock();
+    init_signal_stack(worker);
+    if (getInstance().is_preemptive)
+        init_worker_timer(worker, getInstance().quantum_length);
+    worker_loop(worker);
+    return nullptr;
+}
+
+
+/*
+ * static functions
+ * */
+int UThreadsManager::init(const uthread_config_t *config) {
+    GUARD(config == nullptr, UTHREADS_FAIL("The configuration must be not null."));
+    return UThreadsManager::getInstance().uthread_init(*config);
+}
+
+UThreadsManager &UThreadsManager::getInstance() {
+    //Never destroyed, workers may still use it while the process exits
+    static UThreadsManager *instance = new UThreadsManager();
+    return *instance;
+}
+
+void UThreadsManager::timer_handler(int sig, siginfo_t *info, void *context) {
+    //SIGVTALRM stays blocked while the handler runs, returning from it restores
+    //the mask of the interrupted thread, so no masking is needed here.
+    UThreadsManager &instance = getInstance();
+    //The virtual timer signals the process, so a kernel thread that isn't a
+    //worker and doesn't block SIGVTALRM may get the tick, it belongs to the
+    //single worker
+    if (current_worker() == nullptr) {
+        pthread_kill(instance.workers[0]->thread, SIGVTALRM);
+        return;
+    }
+    instance.scheduler_lock.lock();
+    //Counted until the switch to the next thread, or until the handler ends
+    Worker *ticked = current_worker();
+    ticked->tick_start = UThread::clock_ns();
+    ticked->clock_ns = ticked->tick_start;
+    if (instance.event_trace.is_enabled())
+        instance.event_trace.record(ticked->tick_start, UTHREAD_TRACE_TICK,
+                                    ticked->running_thread ? ticked->running_thread->get_tid() : -1,
+                                    ticked->id, 0);
+    //Only an expiration of the timer is a sample, kicks and forwarded ticks
+    //come from pthread_kill
+    UThread *interrupted = ticked->running_thread;
+    if (instance.profiler.is_enabled() && info->si_code != SI_TKILL && interrupted != nullptr)
+        instance.profiler.sample(interrupted->get_tid(), (const ucontext_t *) context,
+                                 interrupted->stack.base != nullptr ? interrupted->stack
+                                                                    : instance.main_stack);
+    ticked->stats.timer_ticks += 1;
+    //Wake threads that finished their "sleep" or their wait for I/O
+    handle_waiting_threads();
+    //Switch threads according to Round-Robin algorithm.
+    instance.switch_threads();
+    Worker *worker = current_worker();
+    if (worker->tick_start != 0)
+        instance.count_tick(worker, UThread::clock_ns());
+    instance.scheduler_lock.unlock();
+}
+
+int UThreadsManager::init_itimer(int quantum) {
+    struct sigaction sa = {nullptr};
+
+    // Install timer_handler as the signal handler for SIGVTALRM.
+    sa.sa_sigaction = timer_handler;
+    sa.sa_flags = SA_SIGINFO;
     if (sigaction(SIGVTALRM, &sa, NULL) < 0) {
         SYSCALL_FAIL("sigaction error.");
         getInstance().free_all_memory();
         exit(1);
     }
+    //A zero quantum only installs the handler, the workers arm their own timers
+    if (quantum == 0)
+        return SUCCESS;
     return reset_timer(quantum);
 
 }
 
+int UThreadsManager::init_worker_timer(Worker *worker, int quantum) {
+    struct sigevent event = {};
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGVTALRM;
+    event._sigev_un._tid = worker->kernel_tid;
+    //Either the CPU time of this kernel thread only, like the virtual timer
+    //does for the whole process, or the wall-clock time. The timer is
+    //periodic, so the quantums don't drift while the worker runs threads.
+    clockid_t clock = getInstance().timer_source == UTHREAD_TIMER_MONOTONIC ?
+                      CLOCK_MONOTONIC : CLOCK_THREAD_CPUTIME_ID;
+    if (timer_create(clock, &event, &worker->timer) < 0) {
+        SYSCALL_FAIL("timer_create error.");
+        getInstance().free_all_memory();
+        exit(1);
+    }
+    worker->has_timer = true;
+    return set_worker_timer(worker, quantum);
+}
+
+int UThreadsManager::set_worker_timer(Worker *worker, int quantum) {
+    constexpr const int MILLION = 1000000;
+    struct itimerspec spec = {};
+    spec.it_value.tv_sec = quantum / MILLION;
+    spec.it_value.tv_nsec = (quantum % MILLION) * 1000L;
+    spec.it_interval = spec.it_value;
+    if (timer_settime(worker->timer, 0, &spec, NULL) < 0) {
+        SYSCALL_FAIL("timer_settime error.");
+        getInstance().free_all_memory();
+        exit(1);
+    }
+    worker->is_timer_armed = quantum != 0;
+    return SUCCESS;
+}
+
 int UThreadsManager::reset_timer(int quantum) {
-    BLOCK_SIGNALS();
     struct itimerval timer;
     constexpr const int MILLION = 1000000;
     int seconds = quantum / MILLION;
@@ -292,36 +1720,286 @@ int UThreadsManager::reset_timer(int quantum) {
     if (setitimer(ITIMER_VIRTUAL, &timer, NULL) < 0) {
         SYSCALL_FAIL("setitimer error.");
         getInstance().free_all_memory();
-        UNBLOCK_SIGNALS();
         exit(1);
     }
-    UNBLOCK_SIGNALS();
     return SUCCESS;
 
 
 }
 
+int UThreadsManager::init_overflow_handler() {
+    struct sigaction sa = {};
+    sa.sa_sigaction = stack_overflow_handler;
+    sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    if (sigaction(SIGSEGV, &sa, NULL) < 0) {
+        SYSCALL_FAIL("sigaction error.");
+        getInstance().free_all_memory();
+        exit(1);
+    }
+    return SUCCESS;
+}
+
+int UThreadsManager::init_signal_stack(Worker *worker) {
+    stack_t alt_stack = {};
+    try {
+        worker->signal_stack = StackAllocator::getInstance().allocate(OVERFLOW_HANDLER_STACK_SIZE);
+    }
+    catch (std::bad_alloc &e) {
+        SYSCALL_FAIL("bad alloc");
+        getInstance().free_all_memory();
+        exit(1);
+    }
+    alt_stack.ss_sp = worker->signal_stack.base;
+    alt_stack.ss_size = worker->signal_stack.size;
+    if (sigaltstack(&alt_stack, NULL) < 0) {
+        SYSCALL_FAIL("sigaltstack error.");
+        getInstance().free_all_memory();
+        exit(1);
+    }
+    return SUCCESS;
+}
+
+void UThreadsManager::stack_overflow_handler(int sig, siginfo_t *info, void *context) {
+    Worker *worker = current_worker();
+    if (worker == nullptr) {
+        signal(SIGSEGV, SIG_DFL);
+        return;
+    }
+    UThread *running = worker->running_thread;
+    if (running && StackAllocator::getInstance().is_guard_page(info->si_addr, running->stack)) {
+        //Only async-signal-safe calls from here on
+        write(STDERR_FILENO, STACK_OVERFLOW_MESSAGE, sizeof(STACK_OVERFLOW_MESSAGE) - 1);
+        _exit(1);
+    }
+    //Not an overflow, let the fault happen again with the default action
+    signal(SIGSEGV, SIG_DFL);
+}
+
 void UThreadsManager::handle_sleeping_threads() {
     UThreadsManager &instance = UThreadsManager::getInstance();
-    for (auto &ptr: instance.sleeping_threads) {
-        ptr->notify_sleep();
-        if (ptr->has_finished_sleeping()) {
-            ptr->is_sleeping = false;
-            if (!ptr->is_blocked) {
-                ptr->state = READY;
-                instance.threads_scheduler.push_back(ptr);
+    //Runs right before the next quantum starts
+    while (!instance.sleeping_threads.is_empty() &&
+           instance.sleeping_threads.top()->get_wake_quantum() <= instance.overall_quantum_count) {
+        UThread *thread = instance.sleeping_threads.pop();
+        thread->is_sleeping = false;
+        instance.trace(UTHREAD_TRACE_WAKE, thread->get_tid());
+        if (!thread->is_blocked)
+            instance.make_ready(thread);
+    }
+    if (instance.timed_sleepers.is_empty() && instance.sleeping_tasks.empty())
+        return;
+    unsigned long long now = UThread::clock_ns();
+    instance.handle_sleeping_tasks(now);
+    while (!instance.timed_sleepers.is_empty() &&
+           instance.timed_sleepers.top()->get_wake_time() <= now) {
+        UThread *thread = instance.timed_sleepers.pop();
+        thread->is_sleeping = false;
+        instance.trace(UTHREAD_TRACE_WAKE, thread->get_tid());
+        if (!thread->is_blocked)
+            instance.make_ready(thread);
+    }
+}
+
+void UThreadsManager::handle_io_threads() {
+    UThreadsManager &instance = UThreadsManager::getInstance();
+    if (!instance.io_reactor.has_waiters())
+        return;
+    int count = instance.io_reactor.wait(instance.io_events, 0);
+    UThread *ready[2 * MAX_IO_EVENTS];
+    int ready_count = instance.io_reactor.take_ready(instance.io_events, count, ready);
+    for (int i = 0; i < ready_count; i++)
+        if (!ready[i]->is_blocked)
+            instance.make_ready(ready[i]);
+}
+
+void UThreadsManager::handle_woken_threads() {
+    UThreadsManager &instance = UThreadsManager::getInstance();
+    if (instance.wakeups.is_pending())
+        instance.drain_wakeups();
+}
+
+void UThreadsManager::drain_wakeups() {
+    wakeups.clear_signal();
+    for (int id = wakeups.pop(); id != FAILURE; id = wakeups.pop()) {
+        //Terminated since, or a stale handle
+        UThread *thread = threads.get(id);
+        if (thread != nullptr && thread->get_tid() != MAIN_THREAD_ID)
+            resume(thread);
+    }
+}
+
+void UThreadsManager::handle_waiting_threads() {
+    handle_sleeping_threads();
+    handle_io_threads();
+    handle_woken_threads();
+}
+
+void UThreadsManager::make_ready(UThread *thread) {
+    Worker *worker = current_worker();
+    thread->set_state(READY, worker->clock_ns);
+    if (is_adaptive && thread->is_interactive()) {
+        worker->ready_threads->push_front(thread);
+        worker->has_interactive_wakeup = true;
+    } else
+        worker->ready_threads->push_back(thread);
+    wake_parked_worker(worker);
+}
+
+void UThreadsManager::wake_parked_worker(const Worker *worker) {
+    //An idle worker runs the first thread it made READY itself
+    if (worker->running_thread == nullptr && worker->ready_threads->size() <= 1)
+        return;
+    for (Worker *parked: workers) {
+        if (parked->is_parked) {
+            //Cleared here so that the next READY thread wakes another worker
+            parked->is_parked = false;
+            eventfd_write(parked->park_fd, 1);
+            return;
+        }
+    }
+}
+
+int UThreadsManager::make_non_blocking(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0)
+        return FAILURE;
+    if (flags & O_NONBLOCK)
+        return SUCCESS;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0 ? FAILURE : SUCCESS;
+}
+
+void UThreadsManager::switch_to(UThread *thread) {
+    Worker *worker = current_worker();
+    UThread *running_thread = worker->running_thread;
+    //Unless it was blocked or terminated by another worker meanwhile
+    if (running_thread->state == RUNNING) {
+        running_thread->state = READY;
+        worker->ready_threads->push_back(running_thread);
+        wake_parked_worker(worker);
+    }
+    jmp_to_next_thread(thread);
+}
+
+void UThreadsManager::wait_on(RoundRobinSelector *wait_queue) {
+    current_thread()->wait_on(wait_queue);
+    handle_waiting_threads();
+    jmp_to_next_thread();
+}
+
+bool UThreadsManager::stop_waiting(UThread *thread) {
+    thread->is_waiting_sync = false;
+    return !thread->is_blocked;
+}
+
+void UThreadsManager::hand_off(UThread *thread) {
+    //A blocked thread keeps what it was handed until it's resumed
+    if (stop_waiting(thread))
+        switch_to(thread);
+}
+
+UThread *UThreadsManager::release_mutex(MutexState *mutex) {
+    if (mutex->waiters.is_empty()) {
+        //Only threads that were terminated while waiting marked it contended
+        mutex->state.store(0, std::memory_order_release);
+        return nullptr;
+    }
+    UThread *thread = mutex->waiters.get()->front();
+    mutex->owner.store(thread->get_tid() + 1, std::memory_order_relaxed);
+    if (mutex->waiters.is_empty())
+        mutex->state.store(1, std::memory_order_relaxed);
+    return thread;
+}
+
+void UThreadsManager::requeue_on_mutex(UThread *thread, MutexState *mutex) {
+    int state = mutex->state.load();
+    while (true) {
+        if (state == 0) {
+            if (mutex->state.compare_exchange_weak(state, 1, std::memory_order_acquire)) {
+                mutex->owner.store(thread->get_tid() + 1, std::memory_order_relaxed);
+                if (stop_waiting(thread))
+                    make_ready(thread);
+                return;
             }
+        } else if (mutex->state.compare_exchange_weak(state, 2)) {
+            //Keeps waiting, now for the mutex
+            mutex->waiters.get()->push_back(thread);
+            return;
         }
     }
 }
 
-void UThreadsManager::jmp_to_next_thread() {
-    BLOCK_SIGNALS();
+void UThreadsManager::jmp_to_next_thread(UThread *next_thread) {
     UThreadsManager &instance = UThreadsManager::getInstance();
-    running_thread = instance.threads_scheduler.front();
-    running_thread->increment_quantum_count();
+    Worker *worker = current_worker();
+    //nullptr when called from the idle context of the worker
+    UThread *previous_thread = worker->running_thread;
+    ThreadContext *previous_context = previous_thread ? &previous_thread->context
+                                                      : &worker->idle_context;
+    //Left to the context switched to, this stack is in use until then
+    if (previous_thread && previous_thread->state == TERMINATED)
+        worker->zombie = previous_thread;
+    if (next_thread == nullptr)
+        next_thread = instance.select_next_thread(worker);
+    //An idle worker polling for work isn't a scheduling decision
+    if (!previous_thread && next_thread == nullptr)
+        return;
+    //The only clock read of a switch
+    unsigned long long now = UThread::clock_ns();
+    worker->clock_ns = now;
+    bool preempted = worker->tick_start != 0;
+    instance.count_tick(worker, now);
+    int depth = worker->ready_threads->size();
+    int bucket = depth == 0 ? 0 : 32 - __builtin_clz((unsigned int) depth);
+    worker->stats.run_queue_depth[std::min(bucket, UTHREAD_RUN_QUEUE_BUCKETS - 1)] += 1;
+    bool is_traced = instance.event_trace.is_enabled();
+    if (next_thread != previous_thread && previous_thread) {
+        if (is_traced)
+            instance.event_trace.record(now, UTHREAD_TRACE_SWITCH_OUT, previous_thread->get_tid(),
+                                        worker->id, switch_out_reason(previous_thread, preempted));
+        previous_thread->switch_out(now, preempted);
+        //Preempted back to the READY threads when its slice ended, anything
+        //else means the thread gave up the rest of it
+        if (instance.is_adaptive)
+            previous_thread->adapt_slice(preempted && previous_thread->state == READY);
+    }
+    if (next_thread == nullptr) {
+        worker->running_thread = nullptr;
+        this_thread = nullptr;
+        context_switch(previous_context, &worker->idle_context);
+        reap(current_worker());
+        return;
+    }
+    worker->running_thread = next_thread;
+    this_thread = next_thread;
+    //The timer of a worker that was parked starts a new quantum
+    if (worker->has_timer && !worker->is_timer_armed)
+        set_worker_timer(worker, instance.quantum_length);
+    next_thread->start_slice();
+    next_thread->increment_quantum_count();
     instance.increment_overall_quantum_count();
-    running_thread->state = RUNNING;
-    UNBLOCK_SIGNALS();
-    siglongjmp(running_thread->env, MASK_KEEP);
+    if (next_thread != previous_thread) {
+        next_thread->switch_in(now);
+        if (is_traced)
+            instance.event_trace.record(now, UTHREAD_TRACE_SWITCH_IN, next_thread->get_tid(), worker->id,
+                                        previous_thread ? previous_thread->get_tid() : -1);
+        worker->stats.switches += 1;
+        //A thread on the shared stack may have to be copied back to it first
+        context_switch(previous_context,
+                       next_thread->has_shared_stack()
+                       ? SharedStack::getInstance().context_to_resume(next_thread)
+                       : &next_thread->context);
+        //Back on this thread, possibly on another worker
+        reap(current_worker());
+    } else
+        next_thread->state = RUNNING;
+}
+
+void UThreadsManager::count_tick(Worker *worker, unsigned long long now) {
+    if (worker->tick_start == 0)
+        return;
+    unsigned long long elapsed = now - worker->tick_start;
+    worker->tick_start = 0;
+    worker->stats.timer_handler_ns += elapsed;
+    if (elapsed > worker->stats.timer_handler_max_ns)
+        worker->stats.timer_handler_max_ns = elapsed;
 }
@@ -1,41 +1,209 @@
 #ifndef _UTHREADSMANAGER_H_
 #define _UTHREADSMANAGER_H_
 
-#include "MinHeap.h"
+#include "TidAllocator.h"
 #include "UThread.h"
 #include "uthreads.h"
+#include "uthreads_ext.h"
 #include "RoundRobinSelector.h"
+#include "PrioritySelector.h"
+#include "FairSelector.h"
+#include "SleepQueue.h"
+#include "ThreadTable.h"
+#include "IOReactor.h"
+#include "WakeupQueue.h"
+#include "StackAllocator.h"
+#include "SpinLock.h"
+#include "Worker.h"
+#include "EventTrace.h"
+#include "SampleProfiler.h"
+#include "SyncState.h"
 #include <bits/stdc++.h>
 #include <sys/time.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 
-#define MASK_KEEP 1
 #define FAILURE (-1)
 #define SUCCESS 0
-#define JB_SP 6
-#define JB_PC 7
 #define MAIN_THREAD_ID 0
 
 
 class UThreadsManager {
     private:
+        typedef struct PoolTask {
+            void *(*routine)(void *);
+            void *arg;
+        } PoolTask;
+
         int overall_quantum_count;
         int quantum_length;
-        thread_ptr running_thread;
-        std::map<int, thread_ptr> thread_map;
-        MinHeap available_thread_ids;
-        std::set<thread_ptr> sleeping_threads;
-        RoundRobinSelector threads_scheduler;
+        //false in cooperative mode, where threads only switch at yield points
+        bool is_preemptive;
+        uthread_policy_t policy;
+        uthread_timer_source_t timer_source;
+        //Whether the slices of the threads adapt to how they use them
+        bool is_adaptive;
+        //The configured thread limit and the stack size of uthread_spawn
+        int max_threads;
+        size_t default_stack_size;
+        ThreadTable threads;
+        TidAllocator available_thread_ids;
+        SleepQueue sleeping_threads;
+        //Threads sleeping for a duration, see uthread_sleep_ns
+        SleepQueue timed_sleepers;
+        //The tasks given to uthread_pool_submit that no pool thread took yet,
+        //and the pool threads waiting for one.
+        std::deque<PoolTask> pool_tasks;
+        RoundRobinSelector idle_pool_threads;
+        //The pool threads that exist and how many may exist at once
+        int pool_thread_count;
+        int pool_limit;
+        //The posted task nodes no task runner took yet, linked through their
+        //next field, and the runners waiting for one. The queue never
+        //allocates, so the timer can post the nodes of sleeping tasks.
+        uthread_task_node_t *ready_tasks_head;
+        uthread_task_node_t *ready_tasks_tail;
+        int ready_task_count;
+        RoundRobinSelector idle_task_runners;
+        int task_runner_count;
+        //The nodes of sleeping tasks, a heap ordered by wake_time
+        std::vector<uthread_task_node_t *> sleeping_tasks;
+        //The thread-specific data keys by slot, see uthread_key_create. A
+        //slot's version changes whenever its key is deleted, a key is its
+        //slot and its version.
+        bool is_key_used[UTHREAD_KEYS_MAX];
+        unsigned int key_versions[UTHREAD_KEYS_MAX];
+        void (*key_destructors[UTHREAD_KEYS_MAX])(void *);
+        int key_count;
+        IOReactor io_reactor;
+        //Only used inside the scheduler critical section
+        struct epoll_event io_events[MAX_IO_EVENTS];
+        //Threads resumed from outside the scheduler, see uthread_wake
+        WakeupQueue wakeups;
+        //Only recorded inside the scheduler critical section, dumped outside it
+        EventTrace event_trace;
+        //Sampled by the timer handler inside the scheduler critical section
+        SampleProfiler profiler;
+        //The process stack the main thread runs on, the bounds of its frames
+        //for the profiler
+        Stack main_stack;
+        //The workers live as long as the process, worker 0 is the kernel
+        //thread that called uthread_init.
+        std::vector<Worker *> workers;
+        //Serializes every scheduling decision between the workers, always
+        //taken after SIGVTALRM was blocked. It also guards the READY queues of
+        //the workers, which limits how well the workers scale, see Worker.
+        SpinLock scheduler_lock;
+        static thread_local Worker *this_worker;
+        //The thread running on the calling kernel thread, mirrors
+        //this_worker->running_thread so it can be read with a single load that
+        //a migration can't split.
+        static thread_local UThread *this_thread __attribute__((tls_model("initial-exec")));
     public:
         static struct itimerval timer;
 
     private:
         /**
          *  Initializes the thread library and sets the main thread to be running.
-         *  Takes the length of a quantum in microseconds as an argument.
-         * @param quantum - The measurement for the virtual time.
+         * @param config - The limits and the mode of the library, see
+         * uthread_config_t. The timer that preempts threads is armed once,
+         * see uthread_timer_source_t. In the cooperative mode no timer is armed, threads switch only when
+         * they yield, block, sleep or terminate, and SIGVTALRM is never masked.
          * @return - 0 if the method was successful, -1 otherwise.
          */
-        int uthread_init(int quantum);
+        int uthread_init(const uthread_config_t &config);
+
+        /**
+         * Terminates a thread, see uthread_terminate.
+         * @param tid - The ID of the thread.
+         * @param result - The exit value of the thread.
+         * @return On success, return 0. On failure, return -1. Doesn't return
+         * when the calling thread terminates.
+         */
+        int terminate(int tid, void *result);
+
+        /**
+         * Creates a new thread and adds it to the end of the READY threads list.
+         * @param entry_point - The function of a detached thread.
+         * @param routine - The function of a joinable thread, in place of
+         * entry_point.
+         * @param arg - The argument of the routine.
+         * @param stack_size - The size of the thread stack in bytes.
+         * @param as_handle - Whether to return the handle of the thread.
+         * @return On success, return the ID of the created thread. On failure,
+         * return -1.
+         */
+        int spawn(thread_entry_point entry_point, void *(*routine)(void *), void *arg,
+                  size_t stack_size, bool as_handle);
+
+        /**
+         * The part of spawn inside the critical section, the caller checked
+         * that a tid is available.
+         * @param entry_point - The function of a detached thread.
+         * @param routine - The function of a joinable thread, in place of
+         * entry_point.
+         * @param arg - The argument of the routine.
+         * @param stack_size - The size of the thread stack in bytes.
+         * @return The new thread, at the end of the READY threads list. Throws
+         * std::bad_alloc if its stack can't be allocated, the tid is released
+         * then.
+         */
+        UThread *create_thread(thread_entry_point entry_point, void *(*routine)(void *),
+                               void *arg, size_t stack_size);
+
+        /**
+         * The routine of the pool threads: runs the submitted tasks one after
+         * the other, and waits in idle_pool_threads while there are none.
+         * @param arg - Unused.
+         * @return Never returns.
+         */
+        static void *pool_thread_main(void *arg);
+
+        /**
+         * The routine of the task runners: runs the posted nodes one after
+         * the other, and waits in idle_task_runners while there are none.
+         * Each runner takes its share of the queue at a time.
+         * @param arg - Unused.
+         * @return Never returns.
+         */
+        static void *task_runner_main(void *arg);
+
+        /**
+         * Creates a task runner per worker unless they exist, inside the
+         * critical section.
+         * @return 0 if there is a task runner, -1 if none can be created.
+         */
+        int start_task_runners();
+
+        /**
+         * Queues a node for the task runners and wakes an idle one. Never
+         * allocates, so the timer may call it.
+         * @param node - The node.
+         */
+        void post_task(uthread_task_node_t *node);
+
+        /**
+         * Posts the nodes of the sleeping tasks that are due.
+         * @param now - The current time, see UThread::clock_ns.
+         */
+        void handle_sleeping_tasks(unsigned long long now);
+
+        /**
+         * Orders sleeping_tasks with the first task due on top.
+         * @return Whether the first node wakes after the second.
+         */
+        static bool wakes_later(const uthread_task_node_t *a, const uthread_task_node_t *b);
+
+        /**
+         * Runs the destructors of the thread-specific data keys on the values
+         * of a thread about to terminate, outside the critical section so
+         * they may call the library. Returns at once if no key exists.
+         * @param tid - The ID of the thread, or a handle of it.
+         */
+        void run_key_destructors(int tid);
 
 
         UThreadsManager();
@@ -48,24 +216,209 @@ class UThreadsManager {
         /**
          * The method schedules the threads, which one should be currently RUNNING
          * and which one should be READY to run (It schedules each one according
-         * to the ROUND ROBIN scheduling algorithm).
+         * to the scheduling policy). On a timer tick the running thread keeps
+         * running until its slice ends.
          */
         void switch_threads();
 
         /**
          * The method changes the next thread in the pool to be the running thread
-         * and jmp to its PC by using "siglongjmp".
+         * and switches to its saved context. When the worker has nothing to run
+         * it switches to its idle context instead.
+         * @param next_thread - The thread to run next, already removed from
+         * every queue, or nullptr to pick the next READY one.
          * Updates the quantum count of the thread and the quantum count of the
          * process. (Serves as a helper function for "switch_threads").
+         * Must be called while SIGVTALRM is blocked and the scheduler lock is
+         * held, it returns (still blocked and locked) once the calling thread
+         * is scheduled again.
+         */
+        void jmp_to_next_thread(UThread *next_thread = nullptr);
+
+        /**
+         * Moves the RUNNING thread to the end of the READY threads list and
+         * switches to the given thread right away.
+         * @param thread - The thread to run, already removed from every queue.
          */
-        void jmp_to_next_thread();
+        void switch_to(UThread *thread);
+
+        /**
+         * Makes the RUNNING thread wait in the given wait queue and switches to
+         * the next thread. Returns once the thread was handed what it waits for
+         * and scheduled again.
+         * @param wait_queue - The wait queue of a synchronization object.
+         */
+        void wait_on(RoundRobinSelector *wait_queue);
+
+        /**
+         * Ends the wait of a thread removed from a wait queue.
+         * @param thread - The thread.
+         * @return A boolean value whether the thread can run, false if it was
+         * blocked meanwhile and has to be resumed first.
+         */
+        static bool stop_waiting(UThread *thread);
+
+        /**
+         * Ends the wait of a thread removed from a wait queue and runs it in
+         * place of the RUNNING thread.
+         * @param thread - The thread.
+         */
+        void hand_off(UThread *thread);
+
+        /**
+         * Unlocks a mutex that threads may be waiting for. The first waiting
+         * thread, if any, becomes its owner.
+         * @param mutex - The mutex, its "owner" already cleared.
+         * @return The new owner of the mutex, nullptr if nobody waited.
+         */
+        static UThread *release_mutex(MutexState *mutex);
+
+        /**
+         * Makes a thread signaled on a condition variable the owner of the
+         * mutex if it's unlocked, otherwise moves it to the mutex wait queue.
+         * @param thread - The thread, removed from the condition variable.
+         * @param mutex - The mutex of the condition variable.
+         */
+        void requeue_on_mutex(UThread *thread, MutexState *mutex);
+
+        /**
+         * Counts the time the timer handler of the given worker took, if it
+         * hasn't been counted yet.
+         * @param worker - The worker.
+         * @param now - The current time, see UThread::clock_ns.
+         */
+        void count_tick(Worker *worker, unsigned long long now);
+
+        /**
+         * @return A new, empty READY queue of the scheduling policy.
+         */
+        Selector *create_selector() const;
+
+        /**
+         * Changes a scheduling parameter of a thread. A READY thread is taken
+         * out of its queue meanwhile, so it's placed again accordingly.
+         * @param thread - The thread.
+         * @param update - Changes the parameter.
+         */
+        template<typename Update>
+        static void update_schedule(UThread *thread, Update update);
+
+        /**
+         * Picks the next thread the given worker should run: the first one in
+         * its own READY queue, or one stolen from another worker.
+         * @param worker - The worker that looks for work.
+         * @return The thread, removed from its queue, or nullptr if every READY
+         * queue is empty.
+         */
+        UThread *select_next_thread(Worker *worker);
+
+        /**
+         * @param thread - A thread.
+         * @return The worker currently running the thread, nullptr if none is.
+         */
+        Worker *running_worker(const UThread *thread) const;
+
+        /**
+         * Makes the given worker reach a scheduling point as soon as possible,
+         * used when the thread it runs was blocked or terminated by another one.
+         * @param worker - The worker to interrupt.
+         */
+        static void kick(Worker *worker);
+
+        /**
+         * @return The worker of the calling kernel thread. A user thread may be
+         * resumed on another kernel thread after every switch, so this is never
+         * inlined to keep the compiler from caching the thread-local address.
+         */
+        static Worker *current_worker() __attribute__((noinline));
+
+        /**
+         * Records an event of the calling worker, its arg is the ID of the
+         * calling thread. Only a load when the trace is off.
+         * @param type - A uthread_trace_type_t.
+         * @param tid - The thread the event is about.
+         */
+        void trace(int type, int tid);
+
+        /**
+         * @param thread - A thread being switched out.
+         * @param preempted - Whether the switch happens in the timer handler.
+         * @return Why the thread stops running, a uthread_trace_reason_t.
+         */
+        static int switch_out_reason(const UThread *thread, bool preempted);
+
+        /**
+         * @return The thread running on the calling kernel thread, safe to call
+         * without blocking SIGVTALRM since it's read with a single load.
+         */
+        static UThread *current_thread() __attribute__((noinline));
+
+        /**
+         * The scheduling loop of a worker, runs on its idle context. Entered
+         * with SIGVTALRM blocked and the scheduler lock held.
+         * @param worker - The worker that runs the loop.
+         */
+        static void worker_loop(Worker *worker);
+
+        /**
+         * Reclaims the thread that terminated while running on the worker, if
+         * there is one: destroys it, which caches its stack, and gives its tid
+         * back unless its exit value waits to be joined. Called by whatever
+         * runs right after the switch away from it, still in the scheduler
+         * critical section, so no other worker may take the tid before.
+         * @param worker - The current worker.
+         */
+        static void reap(Worker *worker);
+
+        /**
+         * Gives back the tid of a joinable thread whose exit value was taken.
+         * A thread terminated while running on another worker may not be
+         * reaped yet, its tid is given back by reap then.
+         * @param tid - The ID of the thread.
+         */
+        void release_exited(int tid);
+
+        /**
+         * The entry point of a worker's idle context that doesn't run on the
+         * kernel thread stack.
+         * @param arg - The worker.
+         */
+        static void worker_idle_entry(void *arg);
+
+        /**
+         * The start routine of the kernel threads of workers 1 and up.
+         * @param arg - The worker.
+         */
+        static void *worker_main(void *arg);
+
+        /**
+         * Starts the timer that preempts the threads of the calling worker, on
+         * the clock of the timer source. Used unless a single worker runs on
+         * the virtual timer.
+         * @param worker - The calling worker.
+         * @param quantum - The length of quantum in micro-seconds.
+         * @return 0 if it was successful and exit(1) otherwise.
+         */
+        static int init_worker_timer(Worker *worker, int quantum);
+
+        /**
+         * Arms the timer of the given worker as a periodic timer, or disarms
+         * it, so that a parked worker gets no signals.
+         * @param worker - A worker that has a timer, see init_worker_timer.
+         * @param quantum - The length of quantum in micro-seconds, 0 disarms
+         * the timer.
+         * @return 0 if it was successful and exit(1) otherwise.
+         */
+        static int set_worker_timer(Worker *worker, int quantum);
 
         /**
        *  A handler for SIGVTALRM, the handler is charge of what should happen
        *  every quantum that passes.
        * @param sig - A signal
+       * @param info - Tells the timer apart from kicks.
+       * @param context - The interrupted context, sampled by the profiler.
        */
-        static void timer_handler(int sig);
+        static void timer_handler(int sig, siginfo_t *info, void *context);
 
         /**
          * The method starts the virtual timer of the process.
@@ -75,20 +428,140 @@ class UThreadsManager {
         static int init_itimer(int quantum);
 
         /**
-         * Resets the virtual timer according to a given quantum.
+         * Arms the virtual timer with a given quantum, it reloads itself.
          * @param quantum - The length of quantum in micro-seconds.
          * @return 0 if it was successful and exit(1) otherwise.
          */
         static int reset_timer(int quantum);
 
+        /**
+         * Wakes up the sleeping threads whose wake-up quantum has come and moves
+         * those that aren't blocked to the end of the READY threads list.
+         * Only the threads that are due are touched.
+         */
         static void handle_sleeping_threads();
 
+        /**
+         * Quantums also pass while no worker runs a thread, so the threads
+         * sleeping for quantums wake up while the process is idle. Worker 0
+         * counts them, one per quantum length.
+         * @param worker - The current worker, idle.
+         * @return Whether the worker counts idle quantums.
+         */
+        bool counts_idle_quantums(const Worker *worker) const;
+
+        /**
+         * Counts the idle quantums that passed, see counts_idle_quantums.
+         * @param worker - The current worker, idle.
+         * @param now - The current time, see UThread::clock_ns.
+         * @param idle_since - When the worker became idle, moved forward by
+         * the quantums counted.
+         */
+        void count_idle_quantums(const Worker *worker, unsigned long long now,
+                                 unsigned long long &idle_since);
+
+        /**
+         * @param worker - The current worker, idle.
+         * @param now - The current time, see UThread::clock_ns.
+         * @param idle_since - See count_idle_quantums.
+         * @return How long the worker may sleep in the kernel before it has
+         * something to do, in nanoseconds, -1 when only a wakeup, I/O or
+         * another worker can give it work.
+         */
+        long long idle_timeout(const Worker *worker, unsigned long long now,
+                               unsigned long long idle_since) const;
+
+        /**
+         * Wakes up the threads whose file descriptor became ready and moves
+         * those that aren't blocked to the end of the READY threads list.
+         * Makes no system call when no thread waits for a descriptor.
+         */
+        static void handle_io_threads();
+
+        /**
+         * Resumes the threads pushed to the wakeup queue, a single load when
+         * it's empty.
+         */
+        static void handle_woken_threads();
+
+        /**
+         * Resets the eventfd of the wakeup queue and resumes the threads it
+         * holds, even if it doesn't look pending.
+         */
+        void drain_wakeups();
+
+        /**
+         * Resumes a thread, it's READY again unless it still waits for
+         * something else. See uthread_resume.
+         * @param thread - An existing thread.
+         */
+        void resume(UThread *thread);
+
+        /**
+         * Wakes up every thread whose wait is over, called whenever a new
+         * quantum is about to start.
+         */
+        static void handle_waiting_threads();
+
+        /**
+         * Moves a thread whose wait is over to the end of the READY threads
+         * list of the calling worker, or to its front if the thread is
+         * interactive in the adaptive mode.
+         * @param thread - The thread to move.
+         */
+        void make_ready(UThread *thread);
+
+        /**
+         * Wakes one parked worker to steal the thread the given worker just
+         * put on its READY queue, unless the given worker is idle and runs it
+         * itself. Makes no system call when no worker is parked.
+         * @param worker - The current worker.
+         */
+        void wake_parked_worker(const Worker *worker);
+
+        /**
+         * Puts the given file descriptor in non-blocking mode, if it isn't.
+         * @param fd - The file descriptor.
+         * @return 0 if it was successful and -1 otherwise.
+         */
+        static int make_non_blocking(int fd);
+
+        /**
+         * A handler for SIGSEGV, reports an overflow of the running thread stack
+         * into its guard page and terminates the process. Any other fault is
+         * delivered again with the default action.
+         * @param sig - A signal
+         * @param info - The details of the fault.
+         * @param context - The interrupted context.
+         */
+        static void stack_overflow_handler(int sig, siginfo_t *info, void *context);
+
+        /**
+         * Installs stack_overflow_handler on an alternate signal stack, the
+         * overflowing stack itself can't be used to run it.
+         * @return 0 if it was successful and exit(1) otherwise.
+         */
+        static int init_overflow_handler();
+
+        /**
+         * Gives the calling worker its own alternate signal stack.
+         * @param worker - The calling worker.
+         * @return 0 if it was successful and exit(1) otherwise.
+         */
+        static int init_signal_stack(Worker *worker);
+
     public:
         UThreadsManager(UThreadsManager const &) = delete;
 
         void operator=(UThreadsManager const &) = delete;
 
-        static int init(int quantum);
+        static int init(const uthread_config_t *config);
+
+        /**
+         * Called by every thread the first time it runs, leaves the scheduler
+         * critical section the switch to it was made from.
+         */
+        static void on_thread_start();
 
         static UThreadsManager &getInstance();
 
@@ -101,6 +574,112 @@ class UThreadsManager {
          */
         int uthread_spawn(thread_entry_point entry_point);
 
+        /**
+         * Creates a new thread like uthread_spawn.
+         * @param entry_point - The function of the new thread.
+         * @return On success, return the handle of the created thread. On
+         * failure, return -1.
+         */
+        int uthread_spawn_handle(thread_entry_point entry_point);
+
+        /**
+         * Creates a new thread like uthread_spawn, running on a stack of the
+         * given size instead of the configured one.
+         * @param entry_point - The function of the new thread.
+         * @param stack_size - The size of the thread stack in bytes, rounded up
+         * to a whole number of pages.
+         * @param as_handle - Whether to return the handle of the thread instead
+         * of its ID.
+         * @return On success, return the ID of the created thread. On failure,
+         * return -1.
+         */
+        int uthread_spawn(thread_entry_point entry_point, size_t stack_size,
+                          bool as_handle = false);
+
+        /**
+         * Creates a new joinable thread that runs the given routine.
+         * @param routine - The function of the new thread, its return value
+         * is the exit value of the thread.
+         * @param arg - The argument of the routine.
+         * @return On success, return the ID of the created thread. On failure,
+         * return -1.
+         */
+        int uthread_create(void *(*routine)(void *), void *arg);
+
+        /**
+         * Waits until a joinable thread terminates and takes its exit value.
+         * The calling thread is BLOCKED meanwhile and woken by the thread
+         * when it terminates.
+         * @param tid - The ID of the thread, or a handle of it.
+         * @param result - Where to copy the exit value, may be nullptr.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_join(int tid, void **result);
+
+        /**
+         * Makes a joinable thread detached, it's removed as soon as it
+         * terminates. The exit value of a thread that already terminated is
+         * dropped.
+         * @param tid - The ID of the thread, or a handle of it.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_detach(int tid);
+
+        /**
+         * Creates n joinable threads in a single critical section.
+         * @param routine - The function of the new threads.
+         * @param args - The arguments of the threads, nullptr for none.
+         * @param n - The amount of threads.
+         * @param tids - Where to store the IDs of the new threads.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_spawn_batch(void *(*routine)(void *), void *const args[], int n, int tids[]);
+
+        /**
+         * Queues a task for the pool threads, and hands it to an idle one or
+         * creates a new one while there are fewer than pool_limit.
+         * @param routine - The function of the task.
+         * @param arg - The argument of the routine.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_pool_submit(void *(*routine)(void *), void *arg);
+
+        /**
+         * Queues a node for the task runners, creating them first.
+         * @param node - The node.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_task_post(uthread_task_node_t *node);
+
+        /**
+         * Adds a node to the sleeping tasks.
+         * @param node - The node.
+         * @param nsecs - How long it sleeps in nanoseconds.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_task_sleep_ns(uthread_task_node_t *node, long long nsecs);
+
+        /**
+         * Makes a node join a thread, it's posted when the thread terminates.
+         * @param node - The node.
+         * @param tid - The ID of the thread, or a handle of it.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_task_join(uthread_task_node_t *node, int tid);
+
+        /**
+         * Terminates the calling thread with the given exit value, see
+         * uthread_terminate.
+         * @param result - The exit value, handed to the thread that joins it.
+         */
+        void uthread_exit(void *result);
+
+        /**
+         * @param tid - The ID of an existing thread, or a handle of it.
+         * @return The handle of the thread, -1 if there's no such thread.
+         */
+        int uthread_get_handle(int tid);
+
         /**
          * Free all the memory the instance is currently using.
          */
@@ -131,6 +710,14 @@ class UThreadsManager {
          */
         int uthread_resume(int tid);
 
+        /**
+         * Queues a thread to be resumed by the scheduler at its next switch,
+         * see uthread_wake. Lock free and async-signal-safe.
+         * @param tid - The ID of the thread or a handle of it.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_wake(int tid);
+
         /**
          * Blocks the RUNNING thread for a specified number of quantums.
          * When the sleeping time is over, the thread should go back to the end of the READY queue.
@@ -141,6 +728,245 @@ class UThreadsManager {
          */
         int uthread_sleep(int num_quantums);
 
+        /**
+         * Blocks the RUNNING thread for the given time, see uthread_sleep_ns.
+         * @param nsecs - The duration in nanoseconds.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_sleep_ns(long long nsecs);
+
+        /**
+         * Moves the RUNNING thread to the end of the READY threads list and
+         * starts a new quantum, like the timer does when a quantum ends.
+         * If no other thread is READY the calling thread keeps running.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_yield();
+
+        /**
+         * Sets the priority of a thread, used by the priority policy.
+         * @param tid - The ID of the thread.
+         * @param priority - Between 0 and UTHREAD_PRIORITY_LEVELS - 1, higher
+         * runs first.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_set_priority(int tid, int priority);
+
+        /**
+         * Sets the weight of a thread, used by the fair policy.
+         * @param tid - The ID of the thread.
+         * @param weight - Between UTHREAD_MIN_WEIGHT and UTHREAD_MAX_WEIGHT.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_set_weight(int tid, int weight);
+
+        /**
+         * Sets the length of the slice of a thread.
+         * @param tid - The ID of the thread.
+         * @param quantum_usecs - The length in micro-seconds, rounded up to
+         * whole quantums, 0 for the default slice.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_set_quantum(int tid, int quantum_usecs);
+
+        /**
+         * Copies the counters of the scheduler, the sums of the counters of
+         * the workers. Reads them without the scheduler lock, so a snapshot
+         * taken while the workers run may be a few events apart between them.
+         * @param stats - Where to copy them.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_stats(uthread_stats_t *stats);
+
+        /**
+         * Copies the counters of the thread with the given ID.
+         * @param tid - The ID of the thread.
+         * @param stats - Where to copy them.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_thread_stats(int tid, uthread_thread_stats_t *stats);
+
+        /**
+         * Starts or stops recording scheduler events.
+         * @param on - Nonzero to record them.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_trace_enable(int on);
+
+        /**
+         * Writes the recorded events, see EventTrace::dump.
+         * @param fd - The file descriptor to write to.
+         * @return On success, the amount of events. On failure, return -1.
+         */
+        int uthread_trace_dump(int fd);
+
+        /**
+         * Starts or stops sampling the running threads at every tick.
+         * @param on - Nonzero to take samples.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_profile_enable(int on);
+
+        /**
+         * Writes the sampled stacks in the folded format.
+         * @param fd - The file descriptor to write to.
+         * @param tid - The ID of a thread, -1 for every thread.
+         * @return On success, the amount of lines. On failure, return -1.
+         */
+        int uthread_profile_dump(int fd, int tid);
+
+        /**
+         * Blocks the RUNNING thread until the given file descriptor is ready.
+         * Other threads keep running meanwhile, the descriptor is polled
+         * whenever a new quantum starts and while a worker is idle.
+         * @param fd - The file descriptor.
+         * @param events - EPOLLIN to wait for input, EPOLLOUT for output or both.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_wait_fd(int fd, int events);
+
+        /**
+         * Like read(2), but only the calling thread waits for input.
+         * The descriptor is put in non-blocking mode.
+         * @return As read(2).
+         */
+        ssize_t uthread_read(int fd, void *buf, size_t count);
+
+        /**
+         * Like write(2), but only the calling thread waits for room.
+         * The descriptor is put in non-blocking mode.
+         * @return As write(2).
+         */
+        ssize_t uthread_write(int fd, const void *buf, size_t count);
+
+        /**
+         * Like accept(2), but only the calling thread waits for a connection.
+         * The listening socket is put in non-blocking mode, the accepted one
+         * is created in non-blocking mode.
+         * @return As accept(2).
+         */
+        int uthread_accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen);
+
+        /**
+         * Initializes an unlocked mutex.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_mutex_init(uthread_mutex_t *mutex);
+
+        /**
+         * @return On success, return 0. If the mutex is locked return -1.
+         */
+        int uthread_mutex_destroy(uthread_mutex_t *mutex);
+
+        /**
+         * Locks the mutex, the RUNNING thread waits while another one owns it.
+         * An unlocked mutex is taken with a single atomic instruction.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_mutex_lock(uthread_mutex_t *mutex);
+
+        /**
+         * Locks the mutex only if it's unlocked.
+         * @return 0 if the mutex was locked, -1 otherwise.
+         */
+        int uthread_mutex_trylock(uthread_mutex_t *mutex);
+
+        /**
+         * Unlocks the mutex and hands it to the first waiting thread, which
+         * runs right away.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_mutex_unlock(uthread_mutex_t *mutex);
+
+        /**
+         * Initializes a condition variable nobody waits on.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_cond_init(uthread_cond_t *cond);
+
+        /**
+         * @return On success, return 0. If threads wait on it return -1.
+         */
+        int uthread_cond_destroy(uthread_cond_t *cond);
+
+        /**
+         * Unlocks the mutex and makes the RUNNING thread wait on the condition
+         * variable. Returns once it was signaled and owns the mutex again.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_cond_wait(uthread_cond_t *cond, uthread_mutex_t *mutex);
+
+        /**
+         * Moves the first thread waiting on the condition variable to its mutex.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_cond_signal(uthread_cond_t *cond);
+
+        /**
+         * Moves all the threads waiting on the condition variable to its mutex.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_cond_broadcast(uthread_cond_t *cond);
+
+        /**
+         * Initializes a semaphore with the given count.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_sem_init(uthread_sem_t *sem, int count);
+
+        /**
+         * @return On success, return 0. If threads wait on it return -1.
+         */
+        int uthread_sem_destroy(uthread_sem_t *sem);
+
+        /**
+         * Decrements the count of the semaphore, the RUNNING thread waits while
+         * it's 0. A positive count is taken with a single atomic instruction.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_sem_wait(uthread_sem_t *sem);
+
+        /**
+         * Increments the count of the semaphore, or hands the unit to the first
+         * waiting thread, which runs right away.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_sem_post(uthread_sem_t *sem);
+
+        /**
+         * Creates a thread-specific data key in a free slot.
+         * @param key - Where to store the key.
+         * @param destructor - Called on the values of terminating threads,
+         * may be nullptr.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_key_create(uthread_key_t *key, void (*destructor)(void *));
+
+        /**
+         * Frees the slot of a key and changes its version, which drops the
+         * values of the threads for it.
+         * @param key - The key.
+         * @return On success, return 0. On failure, return -1.
+         */
+        int uthread_key_delete(uthread_key_t key);
+
+        /**
+         * Stores the value in the slot of the running thread, without the
+         * scheduler lock: no other thread touches the slots of a running one.
+         * @param key - The key.
+         * @param value - The value.
+         * @return On success, return 0. On failure, return -1.
+         */
+        static int uthread_setspecific(uthread_key_t key, const void *value);
+
+        /**
+         * Reads the slot of the running thread, without getInstance or the
+         * scheduler lock.
+         * @param key - The key.
+         * @return The value, nullptr if there is none.
+         */
+        static void *uthread_getspecific(uthread_key_t key);
+
         /**
          * @return The thread ID of the calling thread.
          */
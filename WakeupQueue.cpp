@@ -0,0 +1,112 @@
+#include "WakeupQueue.h"
+#include "uthreads_ext.h"
+#include <new>
+#include <cstdint>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+WakeupQueue::WakeupQueue() : capacity(0), mask(0), cells(nullptr), queued_ids(nullptr),
+                             tail(0), head(0), is_signaled(false), event_fd(-1) {}
+
+void WakeupQueue::release() {
+    if (cells != nullptr)
+        munmap(cells, sizeof(Cell) * (mask + 1));
+    if (queued_ids != nullptr)
+        munmap(queued_ids, sizeof(std::atomic<unsigned int>) * capacity);
+    if (event_fd >= 0)
+        close(event_fd);
+    cells = nullptr;
+    queued_ids = nullptr;
+    event_fd = -1;
+    capacity = 0;
+}
+
+int WakeupQueue::init(int capacity) {
+    release();
+    unsigned long size = 1;
+    while (size < (unsigned long) capacity)
+        size <<= 1;
+    //Zero filled and committed lazily, like the thread table: no tid queued,
+    //no cell written.
+    void *mapping = mmap(nullptr, sizeof(Cell) * size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED)
+        throw std::bad_alloc();
+    cells = (Cell *) mapping;
+    mask = size - 1;
+    mapping = mmap(nullptr, sizeof(std::atomic<unsigned int>) * capacity, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED) {
+        release();
+        throw std::bad_alloc();
+    }
+    queued_ids = (std::atomic<unsigned int> *) mapping;
+    this->capacity = capacity;
+    tail.store(0);
+    head = 0;
+    is_signaled.store(false);
+    event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return event_fd < 0 ? -1 : 0;
+}
+
+int WakeupQueue::push(int id) {
+    int tid = id & UTHREAD_TID_MASK;
+    if (id < 0 || tid >= capacity)
+        return -1;
+    std::atomic<unsigned int> &queued = queued_ids[tid];
+    unsigned int previous = queued.load(std::memory_order_acquire);
+    while (true) {
+        int merged_id = previous == 0 ? id : merge((int) (previous - 1), id);
+        unsigned int merged = (unsigned int) merged_id + 1;
+        if (merged == previous)
+            return 0;
+        if (queued.compare_exchange_weak(previous, merged, std::memory_order_acq_rel))
+            break;
+    }
+    //Already has a cell, which pops the merged id
+    if (previous != 0)
+        return 0;
+    //A cell per queued tid at most, so the cell of this ticket was popped
+    //a lap ago
+    unsigned long ticket = tail.fetch_add(1, std::memory_order_relaxed);
+    Cell &cell = cells[ticket & mask];
+    cell.tid = tid;
+    cell.sequence.store(ticket + 1, std::memory_order_release);
+    if (!is_signaled.exchange(true)) {
+        uint64_t one = 1;
+        //Only fails if the counter overflows, it's readable either way
+        ssize_t written = write(event_fd, &one, sizeof(one));
+        (void) written;
+    }
+    return 0;
+}
+
+int WakeupQueue::pop() {
+    Cell &cell = cells[head & mask];
+    if (cell.sequence.load(std::memory_order_acquire) != head + 1)
+        return -1;
+    int tid = cell.tid;
+    head += 1;
+    //The tid gets a new cell when it's pushed from now on
+    return (int) (queued_ids[tid].exchange(0, std::memory_order_acq_rel) - 1);
+}
+
+int WakeupQueue::merge(int queued, int id) {
+    int queued_generation = (unsigned int) queued >> UTHREAD_TID_BITS;
+    int generation = (unsigned int) id >> UTHREAD_TID_BITS;
+    if (queued_generation == 0 || generation == 0)
+        return id & UTHREAD_TID_MASK;
+    //Generations wrap around, the newer one is less than half a lap ahead
+    int ahead = (generation - queued_generation + UTHREAD_MAX_GENERATION) % UTHREAD_MAX_GENERATION;
+    return ahead != 0 && ahead < UTHREAD_MAX_GENERATION / 2 ? id : queued;
+}
+
+void WakeupQueue::clear_signal() {
+    uint64_t count;
+    //Read before the flag is reset: a push in between leaves the eventfd
+    //readable for nothing at worst, never unreadable with tids queued.
+    ssize_t res = read(event_fd, &count, sizeof(count));
+    (void) res;
+    is_signaled.store(false);
+}
@@ -0,0 +1,102 @@
+#ifndef _WAKEUP_QUEUE_H_
+#define _WAKEUP_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * The tids of threads to resume, pushed without the scheduler lock by any
+ * kernel thread or signal handler and popped by the scheduler, which only
+ * does so inside its critical section so there is a single consumer at a
+ * time. Every tid is queued at most once until it's popped, so a ring with a
+ * cell per tid never fills up and a push never waits or allocates. The ids
+ * pushed for a queued tid are merged into the one its cell pops, which is
+ * the one that may resume the thread that owns the tid now.
+ * An eventfd becomes readable when the queue gets tids, so idle workers can
+ * sleep in the kernel until there is something to resume.
+ */
+class WakeupQueue {
+    private:
+        typedef struct Cell {
+            //ticket + 1 once the producer with that ticket stored its tid
+            std::atomic<unsigned long> sequence;
+            int tid;
+        } Cell;
+
+        int capacity;
+        //capacity rounded up to a power of 2, minus 1
+        unsigned long mask;
+        Cell *cells;
+        //The id queued for the tid of the index plus 1, 0 while the tid isn't
+        //queued
+        std::atomic<unsigned int> *queued_ids;
+        std::atomic<unsigned long> tail;
+        //Only touched by the consumer
+        unsigned long head;
+        //Whether the eventfd was written since the consumer last read it
+        std::atomic<bool> is_signaled;
+        int event_fd;
+
+        /**
+         * Unmaps the cells and the queued ids, and closes the eventfd.
+         */
+        void release();
+
+        /**
+         * Merges two ids of the same tid. The thread that owns the tid now
+         * has the newest generation, so an older handle is stale and only
+         * the newer one may resume it. A plain tid is never stale.
+         * @return The id that wakes what either of them would.
+         */
+        static int merge(int queued, int id);
+
+    public:
+        WakeupQueue();
+
+        /**
+         * Sizes the queue for the given tids and creates the eventfd, dropping
+         * whatever was queued before.
+         * @param capacity - The tids are between 0 and capacity - 1.
+         * @return 0 on success, -1 if the eventfd can't be created. Throws
+         * std::bad_alloc if the memory can't be mapped.
+         */
+        int init(int capacity);
+
+        /**
+         * Queues a thread to be resumed. Lock free and async-signal-safe.
+         * @param id - A tid or a handle of a thread.
+         * @return 0 on success (also when the tid is queued already, the ids
+         * are merged then), -1 if the tid is out of range.
+         */
+        int push(int id);
+
+        /**
+         * Takes the next queued id, only called by the scheduler.
+         * @return The id, or -1 if the queue is empty or the next producer
+         * hasn't finished its push yet, which then signals the eventfd again.
+         */
+        int pop();
+
+        /**
+         * A single load, so the scheduler can check it at every switch.
+         * @return Whether ids were pushed since the last call to clear_signal.
+         */
+        bool is_pending() const {
+            return is_signaled.load(std::memory_order_acquire);
+        }
+
+        /**
+         * Resets the eventfd, called by the consumer before it pops, so a push
+         * that comes after the pops signals it again.
+         */
+        void clear_signal();
+
+        /**
+         * @return The eventfd, readable while is_pending.
+         */
+        int get_fd() const {
+            return event_fd;
+        }
+};
+
+#endif //_WAKEUP_QUEUE_H_
@@ -0,0 +1,75 @@
+#ifndef _WORKER_H_
+#define _WORKER_H_
+
+#include "UThread.h"
+#include "Selector.h"
+#include "StackAllocator.h"
+#include "ThreadContext.h"
+#include <pthread.h>
+#include <ctime>
+
+/**
+ * A kernel thread that runs user threads. Every worker has its own READY
+ * queue, an idle context it switches to when it has nothing to run, and
+ * its own preemption timer unless a single worker uses the virtual timer.
+ * Known scalability limit: the READY queues have no locks of their own, they
+ * are guarded by the scheduler lock of UThreadsManager like the rest of the
+ * scheduler state. Every make_ready, block, yield, switch, steal and timer
+ * tick on every worker takes that one lock, so the workers schedule one at a
+ * time and stealing only spreads the running of threads, not the scheduling.
+ */
+class Worker {
+    public:
+        int id;
+        pthread_t thread;
+        pid_t kernel_tid;
+        timer_t timer;
+        //nullptr while the worker is idle
+        UThread *running_thread;
+        //Owned by the worker, its type is the scheduling policy.
+        Selector *ready_threads;
+        ThreadContext idle_context;
+        //Only set when the idle context doesn't run on the kernel thread stack.
+        Stack idle_stack;
+        Stack signal_stack;
+        //When the timer handler running on the worker started, 0 outside it.
+        unsigned long long tick_start;
+        //An interactive thread became READY, so the slice of the running
+        //thread ends at the next tick.
+        bool has_interactive_wakeup;
+        //A thread that terminated while running here. It's still on its stack
+        //until the switch away from it is done, so the next context running on
+        //the worker reclaims it, see UThreadsManager::reap.
+        UThread *zombie;
+        //The last clock read of the scheduler on this worker, at a switch, a
+        //tick or a wakeup of the idle worker. State changes outside a switch
+        //are timed with it.
+        unsigned long long clock_ns;
+        //Plain counters of the scheduler on this worker, only updated by the
+        //worker itself. uthread_stats sums them without taking any lock.
+        uthread_stats_t stats;
+        //Written to wake the worker while it's parked in the kernel with
+        //nothing to run, -1 with a single worker, which nothing else wakes.
+        int park_fd;
+        //Set under the scheduler lock before the worker sleeps in the kernel,
+        //cleared by whoever writes its park_fd or by the worker once awake.
+        bool is_parked;
+        //Whether the worker has a timer of its own, see init_worker_timer,
+        //and whether it's armed. It's disarmed while the worker is parked.
+        bool has_timer;
+        bool is_timer_armed;
+
+        Worker(int id, Selector *ready_threads) : id(id), thread(), kernel_tid(0),
+                                                  timer(), running_thread(nullptr),
+                                                  ready_threads(ready_threads),
+                                                  idle_context{nullptr},
+                                                  idle_stack{nullptr, 0},
+                                                  signal_stack{nullptr, 0},
+                                                  tick_start(0),
+                                                  has_interactive_wakeup(false),
+                                                  zombie(nullptr), clock_ns(0), stats(),
+                                                  park_fd(-1), is_parked(false),
+                                                  has_timer(false), is_timer_armed(false) {}
+};
+
+#endif //_WORKER_H_
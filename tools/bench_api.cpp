@@ -0,0 +1,99 @@
+/*
+ * API call latency benchmark: times the calls that look a thread up by its
+ * ID against MAX_THREAD_NUM - 2 live threads, in the cooperative mode so that
+ * no signal lands inside a timed loop. For reference it also times the
+ * lookup alone that the calls used to make, a thread_map.find on a
+ * std::map<int, std::shared_ptr> plus the copy of the shared_ptr, hot in the
+ * cache. It isn't the old API path, which also took the critical section
+ * around the lookup. uthread_get_quantums reads the table without the
+ * scheduler lock, the other calls change the scheduler and take it.
+ *
+ * Build: g++ -std=c++17 -O2 -I.. ../[A-Z]*.cpp ../uthreads.cpp bench_api.cpp -o bench_api -lpthread
+ * Usage: bench_api [<calls>]
+ */
+
+#include "../uthreads.h"
+#include "../uthreads_ext.h"
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <map>
+#include <memory>
+
+#define THREADS (MAX_THREAD_NUM - 2)
+
+static volatile bool stop = false;
+static int tids[THREADS];
+
+static double now() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static void idle() {
+    while (!stop)
+        uthread_yield();
+    uthread_terminate(uthread_get_tid());
+}
+
+static void noop() {
+    uthread_terminate(uthread_get_tid());
+}
+
+/**
+ * Times the old lookup, on a map holding as many threads as the library.
+ */
+static void bench_map_lookup(long calls) {
+    struct Thread {
+        int tid;
+        int quantums;
+        char cold[256];
+    };
+    std::map<int, std::shared_ptr<Thread>> thread_map;
+    for (int tid = 0; tid <= THREADS; tid++)
+        thread_map[tid] = std::make_shared<Thread>(Thread{tid, 0, {}});
+    volatile long sum = 0;
+    double start = now();
+    for (long i = 0; i < calls; i++) {
+        auto it = thread_map.find(tids[i % THREADS]);
+        std::shared_ptr<Thread> thread = it->second;
+        sum = sum + thread->quantums;
+    }
+    printf("%-34s %6.1f ns\n", "std::map find + shared_ptr copy:", (now() - start) / calls);
+}
+
+int main(int argc, char *argv[]) {
+    long calls = argc > 1 ? atol(argv[1]) : 1000000;
+    if (calls <= 0)
+        calls = 1000000;
+    if (uthread_init_cooperative(1) < 0)
+        return 1;
+    for (int i = 0; i < THREADS; i++)
+        if ((tids[i] = uthread_spawn(idle)) < 0)
+            return 1;
+    volatile long sum = 0;
+    double start = now();
+    for (long i = 0; i < calls; i++)
+        sum = sum + uthread_get_quantums(tids[i % THREADS]);
+    printf("%-34s %6.1f ns\n", "uthread_get_quantums:", (now() - start) / calls);
+    start = now();
+    for (long i = 0; i < calls; i++)
+        uthread_set_priority(tids[i % THREADS], UTHREAD_DEFAULT_PRIORITY);
+    printf("%-34s %6.1f ns\n", "uthread_set_priority:", (now() - start) / calls);
+    start = now();
+    for (long i = 0; i < calls; i++) {
+        uthread_block(tids[i % THREADS]);
+        uthread_resume(tids[i % THREADS]);
+    }
+    printf("%-34s %6.1f ns\n", "uthread_block + uthread_resume:", (now() - start) / calls);
+    //Frees a tid for the spawned threads
+    uthread_terminate(tids[THREADS - 1]);
+    start = now();
+    for (long i = 0; i < calls / 10; i++)
+        uthread_terminate(uthread_spawn(noop));
+    printf("%-34s %6.1f ns\n", "uthread_spawn + uthread_terminate:", (now() - start) / (calls / 10));
+    bench_map_lookup(calls);
+    stop = true;
+    uthread_terminate(0);
+}
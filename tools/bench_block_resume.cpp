@@ -0,0 +1,43 @@
+/*
+ * Block/resume churn benchmark: fills the READY threads list with
+ * MAX_THREAD_NUM - 1 threads, then blocks and resumes each of them in turn.
+ * Blocking a READY thread removes it from the middle of the list, so the
+ * time per pair shows whether the removal depends on the list length.
+ *
+ * Build: g++ -std=c++17 -O2 -I.. ../[A-Z]*.cpp ../uthreads.cpp bench_block_resume.cpp -o bench_block_resume -lpthread
+ * Usage: bench_block_resume [<rounds>] [<threads>]
+ */
+
+#include "../uthreads.h"
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+static void spin() {
+    while (true) {}
+}
+
+int main(int argc, char *argv[]) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 20000;
+    int count = argc > 2 ? atoi(argv[2]) : MAX_THREAD_NUM - 1;
+    if (count <= 0 || count >= MAX_THREAD_NUM)
+        count = MAX_THREAD_NUM - 1;
+    //A quantum of a second, the main thread keeps running throughout
+    if (uthread_init(1000000) < 0)
+        return 1;
+    for (int i = 0; i < count; i++)
+        if (uthread_spawn(spin) < 0)
+            return 1;
+    timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int round = 0; round < rounds; round++) {
+        for (int tid = 1; tid <= count; tid++) {
+            uthread_block(tid);
+            uthread_resume(tid);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+    printf("%.1f ns per block+resume with %d READY threads\n", ns / ((double) rounds * count), count);
+    uthread_terminate(0);
+}
@@ -0,0 +1,92 @@
+/*
+ * Spawn/terminate churn benchmark: times a spawn+terminate pair on an empty
+ * table, then terminate+spawn of a random thread among many live ones, which
+ * keeps freeing tids all over the table. Also checks that a handle of a
+ * terminated thread is rejected after its tid was reused, the library prints
+ * an error for it. For the before/after comparison it also times the old
+ * id allocator alone, a std::priority_queue prefilled with every tid.
+ *
+ * Build: g++ -std=c++17 -O2 -I.. ../[A-Z]*.cpp ../uthreads.cpp bench_churn.cpp -o bench_churn -lpthread
+ * Usage: bench_churn [<rounds>] [<live_threads>]
+ */
+
+#include "../uthreads.h"
+#include "../uthreads_ext.h"
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <queue>
+#include <vector>
+
+static void idle() {
+    while (true)
+        uthread_yield();
+}
+
+static double now() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+/**
+ * Times taking the lowest free tid and returning it to the old min heap.
+ */
+static void bench_heap(long rounds) {
+    std::priority_queue<int, std::vector<int>, std::greater<int>> free_ids;
+    for (int tid = 1; tid < MAX_THREAD_NUM; tid++)
+        free_ids.push(tid);
+    double start = now();
+    for (long i = 0; i < rounds; i++) {
+        int tid = free_ids.top();
+        free_ids.pop();
+        free_ids.push(tid);
+    }
+    printf("%.1f ns per tid taken and returned by the old min heap\n", (now() - start) / rounds);
+}
+
+int main(int argc, char *argv[]) {
+    long rounds = argc > 1 ? atol(argv[1]) : 1000000;
+    int live_count = argc > 2 ? atoi(argv[2]) : MAX_THREAD_NUM - 10;
+    if (rounds <= 0)
+        rounds = 1000000;
+    if (live_count <= 0 || live_count >= MAX_THREAD_NUM)
+        live_count = MAX_THREAD_NUM - 10;
+    //No signal lands inside a timed loop
+    if (uthread_init_cooperative(1) < 0)
+        return 1;
+    double start = now();
+    for (long i = 0; i < rounds; i++)
+        uthread_terminate(uthread_spawn(idle));
+    printf("%.1f ns per spawn+terminate\n", (now() - start) / rounds);
+    start = now();
+    for (long i = 0; i < rounds; i++)
+        uthread_terminate(uthread_spawn_handle(idle));
+    printf("%.1f ns per spawn_handle+terminate\n", (now() - start) / rounds);
+
+    int stale = uthread_spawn_handle(idle);
+    uthread_terminate(stale);
+    int reused = uthread_spawn_handle(idle);
+    if ((reused & UTHREAD_TID_MASK) != (stale & UTHREAD_TID_MASK) ||
+        uthread_get_quantums(stale) != -1)
+        return 1;
+    printf("stale handle rejected after its tid was reused\n");
+    uthread_terminate(reused);
+
+    int *live = new int[live_count];
+    for (int i = 0; i < live_count; i++)
+        if ((live[i] = uthread_spawn(idle)) < 0)
+            return 1;
+    unsigned int seed = 1;
+    start = now();
+    for (long i = 0; i < rounds; i++) {
+        seed = seed * 1103515245 + 12345;
+        int k = (int) ((seed >> 16) % live_count);
+        uthread_terminate(live[k]);
+        live[k] = uthread_spawn(idle);
+    }
+    printf("%.1f ns per terminate+spawn with %d live threads\n", (now() - start) / rounds, live_count);
+    bench_heap(rounds);
+    uthread_terminate(0);
+}
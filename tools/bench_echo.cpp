@@ -0,0 +1,110 @@
+/*
+ * Loopback echo benchmark: an echo server and its clients all run as user
+ * threads of one process over TCP on 127.0.0.1. Every connection has a server
+ * thread and a client thread doing request/response round trips, so each
+ * round trip parks both threads in the I/O poller once.
+ *
+ * Build: g++ -std=c++17 -O2 -I.. ../[A-Z]*.cpp ../uthreads.cpp bench_echo.cpp -o bench_echo -lpthread
+ * Usage: bench_echo [<connections>] [<rounds>]
+ */
+
+#include "../uthreads.h"
+#include "../uthreads_ext.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define MESSAGE_SIZE 64
+
+static int listen_fd;
+static int connections;
+static int rounds;
+static int *client_fds;
+static std::atomic<int> next_client{0};
+static std::atomic<int> done{0};
+
+static void fail(const char *what) {
+    perror(what);
+    exit(1);
+}
+
+static void server() {
+    int fd = uthread_accept(listen_fd, nullptr, nullptr);
+    if (fd < 0)
+        fail("accept");
+    char buf[MESSAGE_SIZE];
+    while (true) {
+        ssize_t n = uthread_read(fd, buf, sizeof buf);
+        if (n < 0)
+            fail("read");
+        if (n == 0)
+            break;
+        if (uthread_write(fd, buf, n) != n)
+            fail("write");
+    }
+    close(fd);
+    uthread_terminate(uthread_get_tid());
+}
+
+static void client() {
+    int fd = client_fds[next_client++];
+    char buf[MESSAGE_SIZE] = "ping";
+    for (int r = 0; r < rounds; r++) {
+        if (uthread_write(fd, buf, sizeof buf) != (ssize_t) sizeof buf)
+            fail("write");
+        //A stream may split the reply
+        for (size_t got = 0; got < sizeof buf;) {
+            ssize_t n = uthread_read(fd, buf + got, sizeof buf - got);
+            if (n <= 0)
+                fail("read");
+            got += n;
+        }
+    }
+    close(fd);
+    done++;
+    uthread_terminate(uthread_get_tid());
+}
+
+int main(int argc, char *argv[]) {
+    connections = argc > 1 ? atoi(argv[1]) : 16;
+    rounds = argc > 2 ? atoi(argv[2]) : 10000;
+    if (connections <= 0 || 2 * connections >= MAX_THREAD_NUM)
+        connections = (MAX_THREAD_NUM - 1) / 2;
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof addr;
+    if (listen_fd < 0 || bind(listen_fd, (sockaddr *) &addr, sizeof addr) < 0 ||
+        listen(listen_fd, connections) < 0 || getsockname(listen_fd, (sockaddr *) &addr, &len) < 0)
+        fail("listen");
+    //Loopback connects complete in the backlog, before any accept
+    client_fds = new int[connections];
+    for (int i = 0; i < connections; i++) {
+        client_fds[i] = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        if (client_fds[i] < 0 || connect(client_fds[i], (sockaddr *) &addr, sizeof addr) < 0 ||
+            setsockopt(client_fds[i], IPPROTO_TCP, TCP_NODELAY, &one, sizeof one) < 0)
+            fail("connect");
+    }
+    if (uthread_init(100000) < 0)
+        return 1;
+    timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < connections; i++)
+        if (uthread_spawn(server) < 0 || uthread_spawn(client) < 0)
+            return 1;
+    while (done < connections)
+        uthread_yield();
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+    double trips = (double) connections * rounds;
+    printf("%d connections: %.0f round trips in %.1f ms, %.0f ns per round trip, %.0f round trips/s\n",
+           connections, trips, ns / 1e6, ns / trips, trips / (ns / 1e9));
+    uthread_terminate(0);
+}
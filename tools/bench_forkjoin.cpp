@@ -0,0 +1,168 @@
+/*
+ * Fork/join benchmark: a parallel reduce that splits a range in two threads
+ * until it's small enough to sum, and adds up their results. Runs once with
+ * uthread_create and uthread_join, and once the way it had to be written
+ * before them: uthread_spawn, the range handed over through a table indexed
+ * by tid, and the parent yielding until both children set a flag. A second
+ * round has every leaf wait for a while as if for I/O, which is where the
+ * polling parents keep taking turns for nothing.
+ *
+ * Build: g++ -std=c++17 -O2 -I.. ../[A-Z]*.cpp ../uthreads.cpp bench_forkjoin.cpp -o bench_forkjoin -lpthread
+ * Usage: bench_forkjoin [<elements>] [<leaf>] [<leaf_wait_usecs>] [coop]
+ */
+
+#include "../uthreads.h"
+#include "../uthreads_ext.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#define MAX_THREADS (1 << 16)
+#define REPETITIONS 20
+
+static long *data;
+static long leaf = 1024;
+static long long leaf_wait_ns = 0;
+
+static double now() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static long sum(long low, long high) {
+    if (leaf_wait_ns > 0)
+        uthread_sleep_ns(leaf_wait_ns);
+    long result = 0;
+    for (long i = low; i < high; i++)
+        result += data[i];
+    return result;
+}
+
+struct Range {
+    long low;
+    long high;
+};
+
+static void *join_reduce(void *arg) {
+    Range *range = (Range *) arg;
+    if (range->high - range->low <= leaf)
+        return (void *) (intptr_t) sum(range->low, range->high);
+    long middle = (range->low + range->high) / 2;
+    Range left = {range->low, middle}, right = {middle, range->high};
+    int left_tid = uthread_create(join_reduce, &left);
+    int right_tid = uthread_create(join_reduce, &right);
+    void *left_result, *right_result;
+    if (left_tid < 0 || right_tid < 0 || uthread_join(left_tid, &left_result) < 0 ||
+        uthread_join(right_tid, &right_result) < 0)
+        exit(1);
+    return (void *) ((intptr_t) left_result + (intptr_t) right_result);
+}
+
+struct PollTask {
+    long low;
+    long high;
+    volatile long result;
+    volatile bool done;
+};
+
+static PollTask *volatile tasks_by_tid[MAX_THREADS];
+
+static void poll_reduce_entry();
+
+static long poll_reduce(long low, long high) {
+    if (high - low <= leaf)
+        return sum(low, high);
+    long middle = (low + high) / 2;
+    PollTask left = {low, middle, 0, false}, right = {middle, high, 0, false};
+    int left_tid = uthread_spawn(poll_reduce_entry);
+    int right_tid = uthread_spawn(poll_reduce_entry);
+    if (left_tid < 0 || right_tid < 0)
+        exit(1);
+    tasks_by_tid[left_tid] = &left;
+    tasks_by_tid[right_tid] = &right;
+    while (!left.done || !right.done)
+        uthread_yield();
+    return left.result + right.result;
+}
+
+static void poll_reduce_entry() {
+    int tid = uthread_get_tid();
+    PollTask *task;
+    //Preempted or yielded to before the parent filled the table
+    while ((task = tasks_by_tid[tid]) == nullptr)
+        uthread_yield();
+    tasks_by_tid[tid] = nullptr;
+    task->result = poll_reduce(task->low, task->high);
+    task->done = true;
+    uthread_terminate(tid);
+}
+
+/**
+ * Runs both versions of the reduce and prints their costs.
+ * @return 0 if both got the right sum, 1 otherwise.
+ */
+static int run(long elements, long expected, long repetitions) {
+    long tasks = 2 * ((elements + leaf - 1) / leaf) - 1;
+    //Warms up the stacks of as many threads as a reduce needs
+    Range warm_up = {0, elements};
+    join_reduce(&warm_up);
+    poll_reduce(0, elements);
+    uthread_stats_t before, middle, after;
+    uthread_stats(&before);
+    double start = now();
+    for (long i = 0; i < repetitions; i++) {
+        Range range = {0, elements};
+        if ((intptr_t) join_reduce(&range) != expected)
+            return 1;
+    }
+    double joined = now();
+    uthread_stats(&middle);
+    for (long i = 0; i < repetitions; i++)
+        if (poll_reduce(0, elements) != expected)
+            return 1;
+    double polled = now();
+    uthread_stats(&after);
+    printf("leaves wait %lld us, about %ld threads per reduce\n", leaf_wait_ns / 1000, tasks);
+    printf("  join:    %8.2f ms per reduce, %6.0f ns and %6.2f switches per thread\n",
+           (joined - start) * 1e3 / repetitions, (joined - start) * 1e9 / repetitions / tasks,
+           (double) (middle.switches - before.switches) / repetitions / tasks);
+    printf("  polling: %8.2f ms per reduce, %6.0f ns and %6.2f switches per thread\n",
+           (polled - joined) * 1e3 / repetitions, (polled - joined) * 1e9 / repetitions / tasks,
+           (double) (after.switches - middle.switches) / repetitions / tasks);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    long elements = argc > 1 ? atol(argv[1]) : 1 << 20;
+    leaf = argc > 2 ? atol(argv[2]) : 1024;
+    long long leaf_wait_usecs = argc > 3 ? atoll(argv[3]) : 100;
+    bool cooperative = argc > 4 && strcmp(argv[4], "coop") == 0;
+    if (elements <= 0 || leaf <= 0 || leaf_wait_usecs < 0 || 2 * (elements / leaf) >= MAX_THREADS)
+        return 1;
+    uthread_config_t config;
+    uthread_config_init(&config);
+    config.quantum_usecs = 1000;
+    config.preemptive = !cooperative;
+    config.timer_source = UTHREAD_TIMER_MONOTONIC;
+    config.max_threads = MAX_THREADS;
+    if (uthread_init_ex(&config) < 0)
+        return 1;
+    data = new long[elements];
+    long expected = 0;
+    for (long i = 0; i < elements; i++) {
+        data[i] = i % 7;
+        expected += data[i];
+    }
+    printf("%s, %ld elements, leaf %ld\n", cooperative ? "cooperative" : "preemptive", elements, leaf);
+    if (run(elements, expected, REPETITIONS) != 0)
+        return 1;
+    if (leaf_wait_usecs > 0) {
+        leaf_wait_ns = leaf_wait_usecs * 1000;
+        if (run(elements, expected, 1) != 0)
+            return 1;
+    }
+    uthread_terminate(0);
+}
@@ -0,0 +1,181 @@
+/*
+ * Mixed workload benchmark: batch threads sum large arrays while interactive
+ * threads answer timestamps that a kernel thread writes to their pipes at a
+ * fixed period, doing a little work for each. Prints the batch throughput
+ * and the latency from the write until the interactive thread runs. Runs with
+ * a fixed quantum, in the adaptive mode, and with a long quantum set on the
+ * batch threads through uthread_set_quantum, every mode in its own child.
+ *
+ * Build: g++ -std=c++17 -O2 -I.. ../[A-Z]*.cpp ../uthreads.cpp bench_mixed.cpp -o bench_mixed -lpthread
+ * Usage: bench_mixed [<seconds>] [<quantum_usecs>] [<period_usecs>]
+ */
+
+#include "../uthreads_ext.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <pthread.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define BATCH_THREADS 4
+#define INTERACTIVE_THREADS 4
+#define ARRAY_LONGS (1024 * 1024 / sizeof(long))
+#define BATCH_QUANTUM_USECS 8000
+#define MAX_SAMPLES (1 << 20)
+
+enum Mode {
+    FIXED,
+    ADAPTIVE,
+    OVERRIDE
+};
+
+static Mode mode;
+static long period_ns;
+static volatile bool stop = false;
+static volatile long passes[BATCH_THREADS];
+static long *arrays[BATCH_THREADS];
+static int pipes[INTERACTIVE_THREADS][2];
+static std::atomic<int> next_batch{0};
+static std::atomic<int> next_interactive{0};
+static double latencies[MAX_SAMPLES];
+static int sample_count = 0;
+static volatile long sink;
+
+static unsigned long long now_ns() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static double cpu_seconds() {
+    timespec t;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void batch() {
+    int index = next_batch++;
+    if (mode == OVERRIDE)
+        uthread_set_quantum(uthread_get_tid(), BATCH_QUANTUM_USECS);
+    long *array = arrays[index];
+    while (!stop) {
+        long sum = 0;
+        for (size_t i = 0; i < ARRAY_LONGS; i++)
+            sum += array[i]++;
+        sink = sum;
+        passes[index]++;
+    }
+    uthread_block(uthread_get_tid());
+}
+
+static void interactive() {
+    int index = next_interactive++;
+    unsigned long long sent;
+    while (!stop) {
+        if (uthread_read(pipes[index][0], &sent, sizeof sent) != sizeof sent)
+            continue;
+        if (sample_count < MAX_SAMPLES)
+            latencies[sample_count++] = (now_ns() - sent) / 1e3;
+        //The work of a request
+        unsigned long long start = now_ns();
+        while (now_ns() - start < 20000) {}
+    }
+    uthread_block(uthread_get_tid());
+}
+
+static void *producer(void *) {
+    for (int k = 0; !stop; k++) {
+        timespec delay = {period_ns / 1000000000, period_ns % 1000000000};
+        nanosleep(&delay, nullptr);
+        unsigned long long sent = now_ns();
+        if (write(pipes[k % INTERACTIVE_THREADS][1], &sent, sizeof sent) < 0)
+            break;
+    }
+    return nullptr;
+}
+
+/**
+ * Runs the workload in the given mode for the given time and prints the
+ * throughput and the latency percentiles.
+ * @return The exit status of the child.
+ */
+static int run(const char *name, int seconds, int quantum) {
+    for (int i = 0; i < BATCH_THREADS; i++)
+        arrays[i] = (long *) calloc(ARRAY_LONGS, sizeof(long));
+    for (int i = 0; i < INTERACTIVE_THREADS; i++)
+        if (pipe(pipes[i]) < 0)
+            return 1;
+    uthread_config_t config;
+    uthread_config_init(&config);
+    config.quantum_usecs = quantum;
+    config.timer_source = UTHREAD_TIMER_MONOTONIC;
+    config.adaptive_quantum = mode == ADAPTIVE;
+    if (uthread_init_ex(&config) < 0)
+        return 1;
+    for (int i = 0; i < BATCH_THREADS; i++)
+        if (uthread_spawn(batch) < 0)
+            return 1;
+    for (int i = 0; i < INTERACTIVE_THREADS; i++)
+        if (uthread_spawn(interactive) < 0)
+            return 1;
+    pthread_t thread;
+    if (pthread_create(&thread, nullptr, producer, nullptr) != 0)
+        return 1;
+    unsigned long long start = now_ns();
+    double cpu_start = cpu_seconds();
+    //The main thread waits for the end of the run without taking quantums
+    int timer = timerfd_create(CLOCK_MONOTONIC, 0);
+    itimerspec duration = {};
+    duration.it_value.tv_sec = seconds;
+    unsigned long long expirations;
+    if (timer < 0 || timerfd_settime(timer, 0, &duration, nullptr) < 0 ||
+        uthread_read(timer, &expirations, sizeof expirations) != sizeof expirations)
+        return 1;
+    stop = true;
+    double wall = (now_ns() - start) / 1e9;
+    double cpu = cpu_seconds() - cpu_start;
+    long total = 0;
+    for (int i = 0; i < BATCH_THREADS; i++)
+        total += passes[i];
+    int n = sample_count;
+    if (n == 0)
+        return 1;
+    std::sort(latencies, latencies + n);
+    uthread_stats_t stats;
+    uthread_stats(&stats);
+    printf("%-8s batch %6.0f passes/s (%6.0f per CPU second), %7llu switches | %6d requests, "
+           "latency p50 %6.0f us, p90 %6.0f us, p99 %6.0f us\n",
+           name, total / wall, total / cpu, (unsigned long long) stats.switches, n,
+           latencies[n / 2], latencies[n * 9 / 10], latencies[n * 99 / 100]);
+    fflush(stdout);
+    //The producer is still writing, skip the destructors
+    _exit(0);
+}
+
+int main(int argc, char *argv[]) {
+    int seconds = argc > 1 ? atoi(argv[1]) : 3;
+    int quantum = argc > 2 ? atoi(argv[2]) : 500;
+    period_ns = (argc > 3 ? atol(argv[3]) : 2000) * 1000;
+    if (seconds <= 0)
+        seconds = 3;
+    printf("%d us quantum, a request every %ld us\n", quantum, period_ns / 1000);
+    fflush(stdout);
+    const char *names[] = {"fixed", "adaptive", "override"};
+    for (int i = FIXED; i <= OVERRIDE; i++) {
+        pid_t pid = fork();
+        if (pid < 0)
+            return 1;
+        if (pid == 0) {
+            mode = (Mode) i;
+            exit(run(names[i], seconds, quantum));
+        }
+        int status;
+        if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+/*
+ * Mutex contention benchmark: N threads increment one counter under a single
+ * lock, with a little work inside the critical section so that preemption
+ * often lands while the lock is held. Runs with uthread_mutex_t and with a
+ * spin lock that waits for the holder to be scheduled again, and prints the
+ * uncontended lock+unlock cost first.
+ *
+ * Build: g++ -std=c++17 -O2 -I.. ../[A-Z]*.cpp ../uthreads.cpp bench_mutex.cpp -o bench_mutex -lpthread
+ * Usage: bench_mutex [<threads>] [<iterations>] [<quantum_usecs>]
+ */
+
+#include "../uthreads.h"
+#include "../uthreads_ext.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+static int iterations;
+static uthread_mutex_t mutex = UTHREAD_MUTEX_INITIALIZER;
+static std::atomic_flag spin_lock = ATOMIC_FLAG_INIT;
+static volatile long counter = 0;
+static std::atomic<int> done{0};
+
+static inline void critical_section() {
+    long value = counter;
+    for (volatile int i = 0; i < 200; i++) {}
+    counter = value + 1;
+}
+
+static void mutex_worker() {
+    for (int i = 0; i < iterations; i++) {
+        uthread_mutex_lock(&mutex);
+        critical_section();
+        uthread_mutex_unlock(&mutex);
+    }
+    done++;
+    uthread_terminate(uthread_get_tid());
+}
+
+static void spin_worker() {
+    for (int i = 0; i < iterations; i++) {
+        while (spin_lock.test_and_set(std::memory_order_acquire)) {}
+        critical_section();
+        spin_lock.clear(std::memory_order_release);
+    }
+    done++;
+    uthread_terminate(uthread_get_tid());
+}
+
+static double now() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+/**
+ * Runs the given worker on the given amount of threads and prints the time
+ * per critical section.
+ * @return 0 if the counter is right, 1 otherwise.
+ */
+static int run(const char *name, void (*worker)(), int threads) {
+    counter = 0;
+    done = 0;
+    double start = now();
+    for (int i = 0; i < threads; i++)
+        if (uthread_spawn(worker) < 0)
+            return 1;
+    while (done < threads)
+        uthread_yield();
+    double ns = now() - start;
+    long expected = (long) threads * iterations;
+    printf("%-10s %d threads: %.0f ns per critical section, counter %ld of %ld\n",
+           name, threads, ns / expected, counter, expected);
+    return counter == expected ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+    int threads = argc > 1 ? atoi(argv[1]) : 16;
+    iterations = argc > 2 ? atoi(argv[2]) : 20000;
+    int quantum = argc > 3 ? atoi(argv[3]) : 1000;
+    if (threads <= 0 || threads >= MAX_THREAD_NUM)
+        threads = 16;
+    if (uthread_init(quantum) < 0)
+        return 1;
+    double start = now();
+    for (int i = 0; i < 1000000; i++) {
+        uthread_mutex_lock(&mutex);
+        uthread_mutex_unlock(&mutex);
+    }
+    printf("uncontended lock+unlock: %.1f ns\n", (now() - start) / 1e6);
+    int failed = run("mutex", mutex_worker, threads);
+    failed |= run("spin lock", spin_worker, threads);
+    printf("%d quanta\n", uthread_get_total_quantums());
+    if (failed)
+        return 1;
+    uthread_terminate(0);
+}
@@ -0,0 +1,92 @@
+/*
+ * Ping-pong yield benchmark: two threads hand the CPU to each other with
+ * uthread_yield, timing a switch through the whole library path. For the
+ * before/after comparison it also times the bare context_switch primitive
+ * against the sigsetjmp/siglongjmp round trip, with the signal mask
+ * changes around it, that switch_threads used to make.
+ *
+ * Build: g++ -std=c++17 -O2 -I.. ../[A-Z]*.cpp ../uthreads.cpp bench_pingpong.cpp -o bench_pingpong -lpthread
+ * Usage: bench_pingpong [<switches>] [coop]
+ */
+
+#include "../uthreads_ext.h"
+#include "../ThreadContext.h"
+#include <csetjmp>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+static long switches = 1000000;
+static long count;
+static double start;
+
+static double now_ns() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static ThreadContext main_context, peer_context;
+static char peer_stack[65536];
+
+static void peer(void *) {
+    while (true)
+        context_switch(&peer_context, &main_context);
+}
+
+/**
+ * Times the primitives alone, without the scheduler.
+ */
+static void bench_primitives() {
+    context_make(&peer_context, peer_stack, sizeof(peer_stack), peer, nullptr);
+    double t0 = now_ns();
+    for (long i = 0; i < switches; i++)
+        context_switch(&main_context, &peer_context);
+    printf("context_switch: %.1f ns/switch\n", (now_ns() - t0) / (2.0 * switches));
+
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGVTALRM);
+    static sigjmp_buf buffer;
+    volatile long i = 0;
+    t0 = now_ns();
+    while (i < switches) {
+        sigprocmask(SIG_BLOCK, &set, nullptr);
+        if (sigsetjmp(buffer, 1) == 0) {
+            sigprocmask(SIG_BLOCK, &set, nullptr);
+            sigprocmask(SIG_UNBLOCK, &set, nullptr);
+            siglongjmp(buffer, 1);
+        }
+        i = i + 1;
+    }
+    printf("sigsetjmp/siglongjmp path: %.1f ns/switch\n", (now_ns() - t0) / switches);
+}
+
+static void player() {
+    while (true) {
+        if (++count == 2 * switches) {
+            printf("uthread_yield ping-pong: %.1f ns/switch\n",
+                   (now_ns() - start) / (2.0 * switches));
+            exit(0);
+        }
+        uthread_yield();
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1)
+        switches = atol(argv[1]);
+    bool is_cooperative = argc > 2 && strcmp(argv[2], "coop") == 0;
+    bench_primitives();
+    //A quantum of a second keeps the timer out of the measurement
+    if ((is_cooperative ? uthread_init_cooperative(1) : uthread_init(1000000)) < 0)
+        return 1;
+    uthread_spawn(player);
+    uthread_spawn(player);
+    start = now_ns();
+    //The main thread only takes part in the rotation
+    while (true)
+        uthread_yield();
+}
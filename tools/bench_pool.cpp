@@ -0,0 +1,117 @@
+/*
+ * Task throughput benchmark: runs rounds of short tasks three ways and prints
+ * the tasks per second of each. A uthread_create loop followed by the joins,
+ * uthread_spawn_batch followed by the joins, and uthread_pool_submit with a
+ * semaphore that every task posts when it's done. Runs with a tiny task and
+ * with one that computes for a few micro-seconds.
+ *
+ * Build: g++ -std=c++17 -O2 -I.. ../[A-Z]*.cpp ../uthreads.cpp bench_pool.cpp -o bench_pool -lpthread
+ * Usage: bench_pool [<tasks>] [<rounds>] [coop]
+ */
+
+#include "../uthreads_ext.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <initializer_list>
+
+static volatile long sink;
+static int work;
+static uthread_sem_t done = UTHREAD_SEM_INITIALIZER;
+
+static double now() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void *task(void *arg) {
+    long sum = 0;
+    for (int i = 0; i < work; i++)
+        sum += i ^ (intptr_t) arg;
+    sink = sink + sum;
+    return arg;
+}
+
+static void *pool_task(void *arg) {
+    task(arg);
+    uthread_sem_post(&done);
+    return nullptr;
+}
+
+/**
+ * Runs the rounds all three ways and prints the throughput.
+ * @return 0 on success, 1 if a call failed.
+ */
+static int run(int *tids, int tasks, int rounds) {
+    double total = (double) tasks * rounds;
+    uthread_stats_t before, after;
+    uthread_stats(&before);
+    double start = now();
+    for (int round = 0; round < rounds; round++) {
+        for (int i = 0; i < tasks; i++)
+            if ((tids[i] = uthread_create(task, nullptr)) < 0)
+                return 1;
+        for (int i = 0; i < tasks; i++)
+            if (uthread_join(tids[i], nullptr) < 0)
+                return 1;
+    }
+    double seconds = now() - start;
+    uthread_stats(&after);
+    printf("  %-16s %6.2f M tasks/s, %4.2f switches per task\n", "create + join:", total / seconds / 1e6,
+           (after.switches - before.switches) / total);
+    uthread_stats(&before);
+    start = now();
+    for (int round = 0; round < rounds; round++) {
+        if (uthread_spawn_batch(task, nullptr, tasks, tids) < 0)
+            return 1;
+        for (int i = 0; i < tasks; i++)
+            if (uthread_join(tids[i], nullptr) < 0)
+                return 1;
+    }
+    seconds = now() - start;
+    uthread_stats(&after);
+    printf("  %-16s %6.2f M tasks/s, %4.2f switches per task\n", "batch + join:", total / seconds / 1e6,
+           (after.switches - before.switches) / total);
+    uthread_stats(&before);
+    start = now();
+    for (int round = 0; round < rounds; round++) {
+        for (int i = 0; i < tasks; i++)
+            if (uthread_pool_submit(pool_task, nullptr) < 0)
+                return 1;
+        for (int i = 0; i < tasks; i++)
+            uthread_sem_wait(&done);
+    }
+    seconds = now() - start;
+    uthread_stats(&after);
+    printf("  %-16s %6.2f M tasks/s, %4.2f switches per task\n", "pool:", total / seconds / 1e6,
+           (after.switches - before.switches) / total);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int tasks = argc > 1 ? atoi(argv[1]) : 1000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 200;
+    bool cooperative = argc > 3 && strcmp(argv[3], "coop") == 0;
+    if (tasks <= 0 || tasks >= 4096 || rounds <= 0)
+        return 1;
+    uthread_config_t config;
+    uthread_config_init(&config);
+    config.quantum_usecs = 1000;
+    config.preemptive = !cooperative;
+    config.timer_source = UTHREAD_TIMER_MONOTONIC;
+    config.max_threads = 4096;
+    if (uthread_init_ex(&config) < 0)
+        return 1;
+    int *tids = new int[tasks];
+    for (int task_work: {100, 10000}) {
+        work = task_work;
+        printf("%s, %d tasks per round, %d iterations per task\n",
+               cooperative ? "cooperative" : "preemptive", tasks, work);
+        if (run(tids, tasks, rounds) != 0)
+            return 1;
+    }
+    uthread_terminate(0);
+}
@@ -0,0 +1,104 @@
+/*
+ * Scheduling latency benchmark: one latency-sensitive thread sleeps for a
+ * quantum over and over while batch threads keep the CPU busy, and the time
+ * each uthread_sleep(1) takes until the thread runs again is collected. An
+ * idle run without batch threads gives the baseline. Every policy runs in its
+ * own child, the urgent thread gets the highest priority under the priority
+ * policy and the largest weight under the fair policy.
+ *
+ * Build: g++ -std=c++17 -O2 -I.. ../[A-Z]*.cpp ../uthreads.cpp bench_priority.cpp -o bench_priority -lpthread
+ * Usage: bench_priority [<batch_threads>] [<samples>] [<quantum_usecs>]
+ */
+
+#include "../uthreads.h"
+#include "../uthreads_ext.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static int batch_threads;
+static int samples;
+static int quantum;
+static double *latencies;
+static volatile bool done = false;
+
+static double now() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static void batch() {
+    while (!done) {}
+    uthread_terminate(uthread_get_tid());
+}
+
+static void urgent() {
+    for (int i = 0; i < samples; i++) {
+        double start = now();
+        uthread_sleep(1);
+        latencies[i] = now() - start;
+    }
+    done = true;
+    uthread_terminate(uthread_get_tid());
+}
+
+/**
+ * Runs the urgent thread against the batch threads under the given policy
+ * and prints the percentiles of its sleep times.
+ * @return The exit status of the child.
+ */
+static int run(const char *name, uthread_policy_t policy, int batch_count) {
+    latencies = new double[samples];
+    //The CPU time clocks round a quantum up to the kernel tick
+    uthread_config_t config;
+    uthread_config_init(&config);
+    config.quantum_usecs = quantum;
+    config.policy = policy;
+    config.timer_source = UTHREAD_TIMER_MONOTONIC;
+    if (uthread_init_ex(&config) != 0)
+        return 1;
+    for (int i = 0; i < batch_count; i++)
+        if (uthread_spawn(batch) < 0)
+            return 1;
+    int tid = uthread_spawn(urgent);
+    if (tid < 0 || uthread_set_priority(tid, UTHREAD_PRIORITY_LEVELS - 1) < 0 ||
+        uthread_set_weight(tid, UTHREAD_MAX_WEIGHT) < 0)
+        return 1;
+    while (!done) {}
+    std::sort(latencies, latencies + samples);
+    printf("%-12s sleep(1) p50 %8.1f us, p99 %8.1f us, max %8.1f us\n", name,
+           latencies[samples / 2] / 1e3, latencies[samples * 99 / 100] / 1e3, latencies[samples - 1] / 1e3);
+    fflush(stdout);
+    uthread_terminate(0);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    batch_threads = argc > 1 ? atoi(argv[1]) : 20;
+    samples = argc > 2 ? atoi(argv[2]) : 200;
+    quantum = argc > 3 ? atoi(argv[3]) : 1000;
+    if (batch_threads < 0 || batch_threads >= MAX_THREAD_NUM - 1)
+        batch_threads = 20;
+    if (samples <= 0)
+        samples = 200;
+    printf("%d batch threads, %d us quantum\n", batch_threads, quantum);
+    fflush(stdout);
+    const char *names[] = {"idle", "round robin", "priority", "fair"};
+    const uthread_policy_t policies[] = {UTHREAD_POLICY_ROUND_ROBIN, UTHREAD_POLICY_ROUND_ROBIN,
+                                         UTHREAD_POLICY_PRIORITY, UTHREAD_POLICY_FAIR};
+    for (int i = 0; i < 4; i++) {
+        pid_t pid = fork();
+        if (pid < 0)
+            return 1;
+        if (pid == 0)
+            exit(run(names[i], policies[i], i == 0 ? 0 : batch_threads));
+        int status;
+        if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            return 1;
+    }
+    return 0;
+}
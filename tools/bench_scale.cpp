@@ -0,0 +1,103 @@
+/*
+ * Startup and memory benchmark: initializes the library with room for
+ * UTHREAD_MAX_THREADS threads and small unguarded stacks, then spawns 1k, 10k
+ * and 100k mostly idle threads that each run once and block. Prints the init
+ * and spawn times and the RSS growth of each step. Every count runs in its
+ * own child so the RSS of one doesn't carry over to the next.
+ *
+ * Build: g++ -std=c++17 -O2 -I.. ../[A-Z]*.cpp ../uthreads.cpp bench_scale.cpp -o bench_scale -lpthread
+ * Usage: bench_scale [<threads>...]
+ */
+
+#include "../uthreads_ext.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define STACK_BYTES 4096
+
+static volatile int ran = 0;
+
+static double now() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/**
+ * @return The resident set size of the process in KB, -1 on failure.
+ */
+static long rss_kb() {
+    FILE *file = fopen("/proc/self/status", "r");
+    if (file == nullptr)
+        return -1;
+    char line[256];
+    long rss = -1;
+    while (fgets(line, sizeof line, file))
+        if (strncmp(line, "VmRSS:", 6) == 0)
+            rss = atol(line + 6);
+    fclose(file);
+    return rss;
+}
+
+static void idle() {
+    ran++;
+    uthread_block(uthread_get_tid());
+}
+
+/**
+ * Spawns the given amount of threads and prints the costs.
+ * @return The exit status of the child.
+ */
+static int run(int threads) {
+    long rss_start = rss_kb();
+    double start = now();
+    uthread_config_t config;
+    uthread_config_init(&config);
+    config.preemptive = 0;
+    config.max_threads = UTHREAD_MAX_THREADS;
+    config.stack_size = STACK_BYTES;
+    config.guard_stacks = 0;
+    if (uthread_init_ex(&config) < 0)
+        return 1;
+    double initialized = now();
+    long rss_init = rss_kb();
+    for (int i = 0; i < threads; i++)
+        if (uthread_spawn(idle) < 0)
+            return 1;
+    double spawned = now();
+    while (ran < threads)
+        uthread_yield();
+    double first_run = now();
+    long rss_threads = rss_kb();
+    printf("%6d threads: init %6.1f us +%5ld KB, spawn %6.1f ms (%4.0f ns each), first run %6.1f ms, "
+           "threads +%7ld KB (%.2f KB each)\n",
+           threads, (initialized - start) * 1e6, rss_init - rss_start, (spawned - initialized) * 1e3,
+           (spawned - initialized) * 1e9 / threads, (first_run - spawned) * 1e3, rss_threads - rss_init,
+           (double) (rss_threads - rss_init) / threads);
+    fflush(stdout);
+    uthread_terminate(0);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int defaults[] = {1000, 10000, 100000};
+    int count = argc > 1 ? argc - 1 : 3;
+    for (int i = 0; i < count; i++) {
+        int threads = argc > 1 ? atoi(argv[i + 1]) : defaults[i];
+        if (threads <= 0 || threads >= UTHREAD_MAX_THREADS)
+            return 1;
+        pid_t pid = fork();
+        if (pid < 0)
+            return 1;
+        if (pid == 0)
+            exit(run(threads));
+        int status;
+        if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * Worker scaling benchmark: runs a fixed batch of CPU-bound threads on 1..N
+ * kernel threads and prints the wall time of each. The library can only be
+ * initialized once per process, so every worker count runs in its own child.
+ *
+ * Build: g++ -std=c++17 -O2 -I.. ../[A-Z]*.cpp ../uthreads.cpp bench_scaling.cpp -o bench_scaling -lpthread
+ * Usage: bench_scaling [<max_workers>] [<threads>]
+ */
+
+#include "../uthreads_ext.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static std::atomic<int> done{0};
+static volatile double sink;
+
+static void work() {
+    double x = 0;
+    for (long i = 0; i < 30000000; i++)
+        x += i * 0.5;
+    sink = x;
+    done++;
+}
+
+/**
+ * Runs the batch on the given amount of workers and prints its wall time.
+ * @return The exit status of the child.
+ */
+static int run(int workers, int threads) {
+    if (uthread_init_workers(1000, workers) != 0)
+        return 1;
+    timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < threads; i++)
+        if (uthread_spawn(work) < 0)
+            return 1;
+    while (done < threads) {}
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+    printf("%d workers: %.1f ms for %d threads, %d quanta\n", workers, ms, threads, uthread_get_total_quantums());
+    fflush(stdout);
+    uthread_terminate(0);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int max_workers = argc > 1 ? atoi(argv[1]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = argc > 2 ? atoi(argv[2]) : 16;
+    if (max_workers <= 0)
+        max_workers = 1;
+    if (threads <= 0 || threads >= MAX_THREAD_NUM)
+        threads = 16;
+    for (int workers = 1; workers <= max_workers; workers++) {
+        pid_t pid = fork();
+        if (pid < 0)
+            return 1;
+        if (pid == 0)
+            exit(run(workers, threads));
+        int status;
+        if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,139 @@
+/*
+ * Shared stack benchmark: parks many idle threads at a given live stack
+ * depth and prints the RSS each one adds, then times a switch between two
+ * threads at the same depth. Runs every depth with threads on their own
+ * stacks and on the shared stack, every combination in its own child. The
+ * shared stack saves memory as long as the depth stays small, and its switch
+ * pays for a copy of the live part of the stack.
+ *
+ * Build: g++ -std=c++17 -O2 -I.. ../[A-Z]*.cpp ../uthreads.cpp bench_shared_stack.cpp -o bench_shared_stack -lpthread
+ * Usage: bench_shared_stack [<threads>] [<depth_bytes>...]
+ */
+
+#include "../uthreads.h"
+#include "../uthreads_ext.h"
+#include <alloca.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define STACK_BYTES (64 * 1024)
+#define SHARED_STACK_BYTES (256 * 1024)
+#define YIELDS 20000
+
+static int depth_bytes;
+static uthread_sem_t parked = UTHREAD_SEM_INITIALIZER;
+static uthread_sem_t gate = UTHREAD_SEM_INITIALIZER;
+static volatile long sink;
+
+static double now() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/**
+ * @return The resident set size of the process in KB, -1 on failure.
+ */
+static long rss_kb() {
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (file == nullptr)
+        return -1;
+    long pages = 0, resident = -1;
+    if (fscanf(file, "%ld %ld", &pages, &resident) != 2)
+        resident = -1;
+    fclose(file);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * Calls the function with depth_bytes of live data below it on the stack.
+ */
+static void at_depth(void (*function)()) {
+    char *data = (char *) alloca(depth_bytes + 16);
+    memset(data, 1, depth_bytes + 16);
+    function();
+    sink = sink + data[depth_bytes / 2];
+}
+
+static void park() {
+    uthread_sem_post(&parked);
+    uthread_sem_wait(&gate);
+}
+
+static void yield_loop() {
+    for (int i = 0; i < YIELDS; i++)
+        uthread_yield();
+}
+
+static void idle_thread() {
+    at_depth(park);
+    uthread_terminate(uthread_get_tid());
+}
+
+static void yield_thread() {
+    at_depth(yield_loop);
+    uthread_sem_post(&parked);
+    uthread_terminate(uthread_get_tid());
+}
+
+/**
+ * Measures one mode at one depth.
+ * @return The exit status of the child.
+ */
+static int run(bool shared, int threads) {
+    uthread_config_t config;
+    uthread_config_init(&config);
+    config.preemptive = 0;
+    config.max_threads = threads + 10;
+    config.stack_size = STACK_BYTES;
+    if (shared)
+        config.shared_stack_size = SHARED_STACK_BYTES;
+    if (uthread_init_ex(&config) < 0)
+        return 1;
+    long rss = rss_kb();
+    for (int i = 0; i < threads; i++)
+        if (uthread_spawn(idle_thread) < 0)
+            return 1;
+    for (int i = 0; i < threads; i++)
+        uthread_sem_wait(&parked);
+    long parked_rss = rss_kb();
+    double start = now();
+    if (uthread_spawn(yield_thread) < 0 || uthread_spawn(yield_thread) < 0)
+        return 1;
+    for (int i = 0; i < 2; i++)
+        uthread_sem_wait(&parked);
+    double seconds = now() - start;
+    printf("%-6s depth %6d B: %7.2f KB RSS per idle thread, %6.0f ns per switch\n", shared ? "shared" : "own",
+           depth_bytes, (double) (parked_rss - rss) / threads, seconds * 1e9 / (2.0 * YIELDS));
+    fflush(stdout);
+    uthread_terminate(0);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int threads = argc > 1 ? atoi(argv[1]) : 5000;
+    if (threads <= 0)
+        return 1;
+    int defaults[] = {256, 1024, 4096, 16384};
+    int count = argc > 2 ? argc - 2 : 4;
+    for (int i = 0; i < count; i++) {
+        depth_bytes = argc > 2 ? atoi(argv[i + 2]) : defaults[i];
+        if (depth_bytes < 0 || depth_bytes > STACK_BYTES / 2)
+            return 1;
+        for (int shared = 0; shared <= 1; shared++) {
+            pid_t pid = fork();
+            if (pid < 0)
+                return 1;
+            if (pid == 0)
+                exit(run(shared, threads));
+            int status;
+            if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,166 @@
+/*
+ * Task benchmark: compares the stackless tasks of uthreads_task.h with
+ * threads of uthread_spawn. Prints the heap bytes of a task frame and the RSS
+ * each parked task and parked thread adds, the time to spawn and run a tiny
+ * unit of work, and the time of a resume: tasks doing co_await yield()
+ * against threads calling uthread_yield.
+ *
+ * Build: g++ -std=c++20 -O2 -I.. ../[A-Z]*.cpp ../uthreads.cpp bench_tasks.cpp -o bench_tasks -lpthread
+ * Usage: bench_tasks [<units>] [coop]
+ */
+
+#include "../uthreads.h"
+#include "../uthreads_ext.h"
+#include "../uthreads_task.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <new>
+
+#define YIELDS 100
+#define PARK_NS 3600000000000LL
+
+static std::atomic<long> heap_bytes{0};
+static std::atomic<long> done_count{0};
+
+void *operator new(size_t size) {
+    heap_bytes += size;
+    void *memory = malloc(size);
+    if (memory == nullptr)
+        throw std::bad_alloc();
+    return memory;
+}
+
+void operator delete(void *memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+    free(memory);
+}
+
+static double now() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/**
+ * @return The resident set size of the process in KB, -1 on failure.
+ */
+static long rss_kb() {
+    FILE *file = fopen("/proc/self/status", "r");
+    if (file == nullptr)
+        return -1;
+    char line[256];
+    long rss = -1;
+    while (fgets(line, sizeof line, file))
+        if (strncmp(line, "VmRSS:", 6) == 0)
+            rss = atol(line + 6);
+    fclose(file);
+    return rss;
+}
+
+static uthread::task<void> tiny_task() {
+    done_count++;
+    co_return;
+}
+
+static uthread::task<void> yield_task() {
+    for (int i = 0; i < YIELDS; i++)
+        co_await uthread::yield();
+    done_count++;
+}
+
+static uthread::task<void> parked_task() {
+    done_count++;
+    co_await uthread::sleep_for(PARK_NS);
+}
+
+static void tiny_thread() {
+    done_count++;
+    uthread_terminate(uthread_get_tid());
+}
+
+static void yield_thread() {
+    for (int i = 0; i < YIELDS; i++)
+        uthread_yield();
+    done_count++;
+    uthread_terminate(uthread_get_tid());
+}
+
+static void parked_thread() {
+    done_count++;
+    uthread_sleep_ns(PARK_NS);
+}
+
+static void wait_for(long count) {
+    while (done_count < count)
+        uthread_yield();
+    done_count = 0;
+}
+
+int main(int argc, char *argv[]) {
+    int units = argc > 1 ? atoi(argv[1]) : 10000;
+    bool cooperative = argc > 2 && strcmp(argv[2], "coop") == 0;
+    if (units <= 0 || units >= 20000)
+        return 1;
+    uthread_config_t config;
+    uthread_config_init(&config);
+    config.quantum_usecs = 1000;
+    config.preemptive = !cooperative;
+    config.timer_source = UTHREAD_TIMER_MONOTONIC;
+    config.max_threads = 2 * units + 100;
+    if (uthread_init_ex(&config) < 0)
+        return 1;
+    printf("%s, %d units\n", cooperative ? "cooperative" : "preemptive", units);
+    long bytes = heap_bytes;
+    {
+        uthread::task<void> task = yield_task();
+    }
+    printf("task frame: %ld bytes on the heap, thread stack: %zu bytes\n", heap_bytes - bytes, config.stack_size);
+
+    //First, while no thread stack was touched yet
+    long rss = rss_kb();
+    for (int i = 0; i < units; i++)
+        uthread::spawn(parked_task());
+    wait_for(units);
+    long tasks_rss = rss_kb();
+    for (int i = 0; i < units; i++)
+        if (uthread_spawn(parked_thread) < 0)
+            return 1;
+    wait_for(units);
+    long threads_rss = rss_kb();
+    printf("parked: task +%.2f KB RSS, thread +%.2f KB RSS\n", (double) (tasks_rss - rss) / units,
+           (double) (threads_rss - tasks_rss) / units);
+
+    double start = now();
+    for (int i = 0; i < units; i++)
+        uthread::spawn(tiny_task());
+    wait_for(units);
+    double tasks_done = now();
+    for (int i = 0; i < units; i++)
+        if (uthread_spawn(tiny_thread) < 0)
+            return 1;
+    wait_for(units);
+    double threads_done = now();
+    printf("spawn+run: task %.0f ns, thread %.0f ns\n", (tasks_done - start) * 1e9 / units,
+           (threads_done - tasks_done) * 1e9 / units);
+
+    //A hundred units taking turns
+    start = now();
+    for (int i = 0; i < 100; i++)
+        uthread::spawn(yield_task());
+    wait_for(100);
+    tasks_done = now();
+    for (int i = 0; i < 100; i++)
+        if (uthread_spawn(yield_thread) < 0)
+            return 1;
+    wait_for(100);
+    threads_done = now();
+    printf("resume: task %.0f ns, thread %.0f ns\n", (tasks_done - start) * 1e9 / (100 * YIELDS),
+           (threads_done - tasks_done) * 1e9 / (100 * YIELDS));
+    uthread_terminate(0);
+}
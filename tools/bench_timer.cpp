@@ -0,0 +1,145 @@
+/*
+ * Quantum jitter and timer overhead benchmark: two threads spin and note
+ * every gap in their own clock readings, which marks a switch. The length of
+ * each stint between switches shows the jitter of the quantum, the time lost
+ * in the gaps and the timer_handler_ns counter show the cost of a tick. Every
+ * timer source and quantum runs in its own child. For the before/after
+ * comparison it also times the setitimer(ITIMER_VIRTUAL) re-arm that
+ * init_itimer used to make on every tick.
+ *
+ * Build: g++ -std=c++17 -O2 -I.. ../[A-Z]*.cpp ../uthreads.cpp bench_timer.cpp -o bench_timer -lpthread
+ * Usage: bench_timer [<milliseconds>]
+ */
+
+#include "../uthreads_ext.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+//A gap this long in the readings of a thread means it was switched out
+#define GAP_NS 3000
+#define MAX_STINTS (1 << 20)
+
+static unsigned long long end_ns;
+static volatile bool stop = false;
+static double stints[MAX_STINTS];
+static int stint_count = 0;
+static unsigned long long busy_ns = 0;
+
+static unsigned long long now_ns() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static void spin() {
+    unsigned long long start = now_ns(), last = start;
+    while (true) {
+        unsigned long long t = now_ns();
+        if (t - last > GAP_NS) {
+            if (stint_count < MAX_STINTS)
+                stints[stint_count++] = (last - start) / 1e3;
+            busy_ns += last - start;
+            start = t;
+        }
+        last = t;
+        if (t > end_ns || stop) {
+            busy_ns += last - start;
+            stop = true;
+            return;
+        }
+    }
+}
+
+static void other() {
+    spin();
+    uthread_terminate(uthread_get_tid());
+}
+
+/**
+ * Runs the two threads with the given timer and prints the stint statistics.
+ * @return The exit status of the child.
+ */
+static int run(const char *name, uthread_timer_source_t source, int quantum, int milliseconds) {
+    uthread_config_t config;
+    uthread_config_init(&config);
+    config.quantum_usecs = quantum;
+    config.timer_source = source;
+    if (uthread_init_ex(&config) < 0)
+        return 1;
+    unsigned long long start = now_ns();
+    end_ns = start + milliseconds * 1000000ULL;
+    if (uthread_spawn(other) < 0)
+        return 1;
+    spin();
+    unsigned long long wall = now_ns() - start;
+    int n = stint_count;
+    if (n == 0)
+        return 1;
+    std::sort(stints, stints + n);
+    double sum = 0, squares = 0;
+    for (int i = 0; i < n; i++)
+        sum += stints[i];
+    double mean = sum / n;
+    for (int i = 0; i < n; i++)
+        squares += (stints[i] - mean) * (stints[i] - mean);
+    uthread_stats_t stats;
+    uthread_stats(&stats);
+    printf("%-10s %5d us: %6d stints, mean %7.1f us, sd %6.1f, p1 %7.1f, p50 %7.1f, p99 %7.1f | "
+           "lost %5.2f us per switch, handler %5.2f us per tick\n",
+           name, quantum, n, mean, sqrt(squares / n), stints[n / 100], stints[n / 2], stints[n * 99 / 100],
+           (double) (wall - busy_ns) / n / 1e3,
+           stats.timer_ticks ? (double) stats.timer_handler_ns / stats.timer_ticks / 1e3 : 0.0);
+    fflush(stdout);
+    uthread_terminate(0);
+    return 0;
+}
+
+/**
+ * Times the re-arm of the virtual timer alone.
+ */
+static void bench_rearm() {
+    itimerval timer = {{0, 1000000}, {0, 1000000}};
+    const int count = 200000;
+    unsigned long long start = now_ns();
+    for (int i = 0; i < count; i++)
+        setitimer(ITIMER_VIRTUAL, &timer, nullptr);
+    timer = {};
+    setitimer(ITIMER_VIRTUAL, &timer, nullptr);
+    printf("setitimer(ITIMER_VIRTUAL) re-arm: %.0f ns\n", (double) (now_ns() - start) / count);
+}
+
+int main(int argc, char *argv[]) {
+    int milliseconds = argc > 1 ? atoi(argv[1]) : 1000;
+    if (milliseconds <= 0)
+        milliseconds = 1000;
+    bench_rearm();
+    fflush(stdout);
+    struct {
+        const char *name;
+        uthread_timer_source_t source;
+        int quantum;
+    } runs[] = {
+            {"virtual",    UTHREAD_TIMER_VIRTUAL,    1000},
+            {"thread cpu", UTHREAD_TIMER_THREAD_CPU, 1000},
+            {"monotonic",  UTHREAD_TIMER_MONOTONIC,  1000},
+            {"monotonic",  UTHREAD_TIMER_MONOTONIC,  100},
+            {"monotonic",  UTHREAD_TIMER_MONOTONIC,  50},
+    };
+    for (auto &run_config: runs) {
+        pid_t pid = fork();
+        if (pid < 0)
+            return 1;
+        if (pid == 0)
+            exit(run(run_config.name, run_config.source, run_config.quantum, milliseconds));
+        int status;
+        if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,201 @@
+/*
+ * Converts a dump of uthread_trace_dump to the Chrome trace event format, for
+ * chrome://tracing and https://ui.perfetto.dev. Every thread gets a row with
+ * its run slices and its events, every worker a row with its timer ticks.
+ *
+ * Build: g++ -std=c++17 -O2 -I.. trace_to_json.cpp -o trace_to_json
+ * Usage: trace_to_json <dump> [<output.json>]
+ */
+
+#include "../uthreads_trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <vector>
+
+//The rows of the threads and of the workers.
+#define THREADS_PID 1
+#define WORKERS_PID 2
+
+static const char *type_name(int type) {
+    switch (type) {
+        case UTHREAD_TRACE_SPAWN:
+            return "spawn";
+        case UTHREAD_TRACE_BLOCK:
+            return "block";
+        case UTHREAD_TRACE_RESUME:
+            return "resume";
+        case UTHREAD_TRACE_WAKE:
+            return "wake";
+        case UTHREAD_TRACE_TERMINATE:
+            return "terminate";
+        case UTHREAD_TRACE_TICK:
+            return "tick";
+        default:
+            return "unknown";
+    }
+}
+
+static const char *reason_name(int reason) {
+    switch (reason) {
+        case UTHREAD_TRACE_PREEMPTED:
+            return "preempted";
+        case UTHREAD_TRACE_YIELDED:
+            return "yielded";
+        case UTHREAD_TRACE_BLOCKED:
+            return "blocked";
+        case UTHREAD_TRACE_SLEPT:
+            return "slept";
+        case UTHREAD_TRACE_WAITED:
+            return "waited";
+        case UTHREAD_TRACE_TERMINATED:
+            return "terminated";
+        default:
+            return "unknown";
+    }
+}
+
+/**
+ * A run slice that started and didn't end yet.
+ */
+typedef struct Run {
+    uint64_t start;
+    int worker;
+} Run;
+
+class JsonWriter {
+    private:
+        FILE *out;
+        uint64_t origin;
+        bool is_first;
+
+        void begin() {
+            fputs(is_first ? "\n" : ",\n", out);
+            is_first = false;
+        }
+
+        double micros(uint64_t time) const {
+            return (double) (time - origin) / 1000.0;
+        }
+
+    public:
+        JsonWriter(FILE *out, uint64_t origin) : out(out), origin(origin), is_first(true) {
+            fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", out);
+        }
+
+        ~JsonWriter() {
+            fputs("\n]}\n", out);
+        }
+
+        void name(const char *kind, int pid, int tid, const char *label) {
+            begin();
+            fprintf(out, "{\"name\":\"%s\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                         "\"args\":{\"name\":\"%s\"}}", kind, pid, tid, label);
+        }
+
+        void run(int tid, const Run &run, uint64_t end, const char *reason) {
+            begin();
+            fprintf(out, "{\"name\":\"running\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+                         "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"worker\":%d,\"reason\":\"%s\"}}",
+                    THREADS_PID, tid, micros(run.start), (double) (end - run.start) / 1000.0,
+                    run.worker, reason);
+        }
+
+        void instant(int pid, const uthread_trace_event_t &event, int tid) {
+            begin();
+            fprintf(out, "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%d,"
+                         "\"ts\":%.3f,\"args\":{\"tid\":%d,\"worker\":%d,\"by\":%d}}",
+                    type_name(event.type), pid, tid, micros(event.time_ns), event.tid,
+                    event.worker, event.arg);
+        }
+};
+
+/**
+ * Reads a whole dump.
+ * @param in - The dump.
+ * @param events - Filled with its events.
+ * @return false if it isn't a dump of a known version.
+ */
+static bool read_dump(FILE *in, std::vector<uthread_trace_event_t> &events) {
+    uthread_trace_header_t header;
+    if (fread(&header, sizeof(header), 1, in) != 1 || header.magic != UTHREAD_TRACE_MAGIC ||
+        header.version != UTHREAD_TRACE_VERSION || header.event_size != sizeof(uthread_trace_event_t))
+        return false;
+    events.resize(header.count);
+    if (fread(events.data(), sizeof(uthread_trace_event_t), header.count, in) != header.count)
+        return false;
+    if (header.dropped != 0)
+        fprintf(stderr, "%llu older events were overwritten before the dump\n",
+                (unsigned long long) header.dropped);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2 && argc != 3) {
+        fprintf(stderr, "Usage: %s <dump> [<output.json>]\n", argv[0]);
+        return 1;
+    }
+    FILE *in = fopen(argv[1], "rb");
+    if (in == nullptr) {
+        perror(argv[1]);
+        return 1;
+    }
+    std::vector<uthread_trace_event_t> events;
+    bool is_valid = read_dump(in, events);
+    fclose(in);
+    if (!is_valid) {
+        fprintf(stderr, "%s: not a uthreads trace dump\n", argv[1]);
+        return 1;
+    }
+    FILE *out = argc == 3 ? fopen(argv[2], "w") : stdout;
+    if (out == nullptr) {
+        perror(argv[2]);
+        return 1;
+    }
+    //Workers record concurrently, the dump is in ticket order
+    std::stable_sort(events.begin(), events.end(),
+                     [](const uthread_trace_event_t &a, const uthread_trace_event_t &b) {
+                         return a.time_ns < b.time_ns;
+                     });
+    {
+        JsonWriter writer(out, events.empty() ? 0 : events.front().time_ns);
+        std::map<int, Run> running;
+        std::map<int, bool> thread_rows, worker_rows;
+        for (const uthread_trace_event_t &event: events) {
+            if (event.type == UTHREAD_TRACE_TICK) {
+                worker_rows[event.worker] = true;
+                writer.instant(WORKERS_PID, event, event.worker);
+                continue;
+            }
+            thread_rows[event.tid] = true;
+            if (event.type == UTHREAD_TRACE_SWITCH_IN) {
+                running[event.tid] = {event.time_ns, event.worker};
+            } else if (event.type == UTHREAD_TRACE_SWITCH_OUT) {
+                //A thread already running when the trace started has no start
+                auto it = running.find(event.tid);
+                if (it != running.end()) {
+                    writer.run(event.tid, it->second, event.time_ns, reason_name(event.arg));
+                    running.erase(it);
+                }
+            } else
+                writer.instant(THREADS_PID, event, event.tid);
+        }
+        //Still running when the dump was taken
+        for (const auto &entry: running)
+            writer.run(entry.first, entry.second, events.back().time_ns, "running");
+        writer.name("process_name", THREADS_PID, 0, "uthreads");
+        writer.name("process_name", WORKERS_PID, 0, "workers");
+        char label[32];
+        for (const auto &entry: thread_rows) {
+            snprintf(label, sizeof(label), "uthread %d", entry.first);
+            writer.name("thread_name", THREADS_PID, entry.first, label);
+        }
+        for (const auto &entry: worker_rows) {
+            snprintf(label, sizeof(label), "worker %d", entry.first);
+            writer.name("thread_name", WORKERS_PID, entry.first, label);
+        }
+    }
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
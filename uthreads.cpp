@@ -1,14 +1,115 @@
 #include "UThreadsManager.h"
 #include "uthreads.h"
+#include "uthreads_ext.h"
+
+void uthread_config_init(uthread_config_t *config) {
+    config->quantum_usecs = 0;
+    config->num_workers = 1;
+    config->preemptive = 1;
+    config->policy = UTHREAD_POLICY_ROUND_ROBIN;
+    config->timer_source = UTHREAD_TIMER_VIRTUAL;
+    config->adaptive_quantum = 0;
+    config->max_threads = MAX_THREAD_NUM;
+    config->stack_size = STACK_SIZE;
+    config->guard_stacks = 1;
+    config->pool_threads = UTHREAD_DEFAULT_POOL_THREADS;
+    config->shared_stack_size = 0;
+    config->trace_events = UTHREAD_DEFAULT_TRACE_EVENTS;
+    config->profile_stacks = UTHREAD_DEFAULT_PROFILE_STACKS;
+}
+
+int uthread_init_ex(const uthread_config_t *config) {
+    return UThreadsManager::init(config);
+}
 
 int uthread_init(int quantum_usecs) {
-    return UThreadsManager::init(quantum_usecs);
+    uthread_config_t config;
+    uthread_config_init(&config);
+    config.quantum_usecs = quantum_usecs;
+    return uthread_init_ex(&config);
+}
+
+int uthread_init_workers(int quantum_usecs, int num_workers) {
+    uthread_config_t config;
+    uthread_config_init(&config);
+    config.quantum_usecs = quantum_usecs;
+    config.num_workers = num_workers;
+    return uthread_init_ex(&config);
+}
+
+int uthread_init_scheduler(int quantum_usecs, int num_workers, uthread_policy_t policy) {
+    uthread_config_t config;
+    uthread_config_init(&config);
+    config.quantum_usecs = quantum_usecs;
+    config.num_workers = num_workers;
+    config.policy = policy;
+    return uthread_init_ex(&config);
+}
+
+int uthread_init_cooperative(int num_workers) {
+    uthread_config_t config;
+    uthread_config_init(&config);
+    config.num_workers = num_workers;
+    config.preemptive = 0;
+    return uthread_init_ex(&config);
 }
 
 int uthread_spawn(thread_entry_point entry_point) {
     return UThreadsManager::getInstance().uthread_spawn(entry_point);
 }
 
+int uthread_spawn_with_stack(thread_entry_point entry_point, size_t stack_size) {
+    return UThreadsManager::getInstance().uthread_spawn(entry_point, stack_size);
+}
+
+int uthread_spawn_handle(thread_entry_point entry_point) {
+    return UThreadsManager::getInstance().uthread_spawn_handle(entry_point);
+}
+
+int uthread_create(uthread_routine_t routine, void *arg) {
+    return UThreadsManager::getInstance().uthread_create(routine, arg);
+}
+
+int uthread_join(int tid, void **result) {
+    return UThreadsManager::getInstance().uthread_join(tid, result);
+}
+
+int uthread_detach(int tid) {
+    return UThreadsManager::getInstance().uthread_detach(tid);
+}
+
+int uthread_spawn_batch(uthread_routine_t routine, void *const args[], int n, int tids[]) {
+    return UThreadsManager::getInstance().uthread_spawn_batch(routine, args, n, tids);
+}
+
+int uthread_pool_submit(uthread_routine_t routine, void *arg) {
+    return UThreadsManager::getInstance().uthread_pool_submit(routine, arg);
+}
+
+int uthread_task_post(uthread_task_node_t *node) {
+    return UThreadsManager::getInstance().uthread_task_post(node);
+}
+
+int uthread_task_sleep_ns(uthread_task_node_t *node, long long nsecs) {
+    return UThreadsManager::getInstance().uthread_task_sleep_ns(node, nsecs);
+}
+
+int uthread_task_join(uthread_task_node_t *node, int tid) {
+    return UThreadsManager::getInstance().uthread_task_join(node, tid);
+}
+
+void uthread_exit(void *result) {
+    UThreadsManager::getInstance().uthread_exit(result);
+}
+
+int uthread_get_handle(int tid) {
+    return UThreadsManager::getInstance().uthread_get_handle(tid);
+}
+
+int uthread_wake(int tid) {
+    return UThreadsManager::getInstance().uthread_wake(tid);
+}
+
 int uthread_terminate(int tid) {
     return UThreadsManager::getInstance().uthread_terminate(tid);
 }
@@ -25,6 +126,138 @@ int uthread_sleep(int num_quantums) {
     return UThreadsManager::getInstance().uthread_sleep(num_quantums);
 }
 
+int uthread_yield() {
+    return UThreadsManager::getInstance().uthread_yield();
+}
+
+int uthread_sleep_ns(long long nsecs) {
+    return UThreadsManager::getInstance().uthread_sleep_ns(nsecs);
+}
+
+int uthread_set_priority(int tid, int priority) {
+    return UThreadsManager::getInstance().uthread_set_priority(tid, priority);
+}
+
+int uthread_set_weight(int tid, int weight) {
+    return UThreadsManager::getInstance().uthread_set_weight(tid, weight);
+}
+
+int uthread_set_quantum(int tid, int quantum_usecs) {
+    return UThreadsManager::getInstance().uthread_set_quantum(tid, quantum_usecs);
+}
+
+int uthread_stats(uthread_stats_t *stats) {
+    return UThreadsManager::getInstance().uthread_stats(stats);
+}
+
+int uthread_thread_stats(int tid, uthread_thread_stats_t *stats) {
+    return UThreadsManager::getInstance().uthread_thread_stats(tid, stats);
+}
+
+int uthread_trace_enable(int on) {
+    return UThreadsManager::getInstance().uthread_trace_enable(on);
+}
+
+int uthread_trace_dump(int fd) {
+    return UThreadsManager::getInstance().uthread_trace_dump(fd);
+}
+
+int uthread_profile_enable(int on) {
+    return UThreadsManager::getInstance().uthread_profile_enable(on);
+}
+
+int uthread_profile_dump(int fd, int tid) {
+    return UThreadsManager::getInstance().uthread_profile_dump(fd, tid);
+}
+
+int uthread_wait_fd(int fd, int events) {
+    return UThreadsManager::getInstance().uthread_wait_fd(fd, events);
+}
+
+ssize_t uthread_read(int fd, void *buf, size_t count) {
+    return UThreadsManager::getInstance().uthread_read(fd, buf, count);
+}
+
+ssize_t uthread_write(int fd, const void *buf, size_t count) {
+    return UThreadsManager::getInstance().uthread_write(fd, buf, count);
+}
+
+int uthread_accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
+    return UThreadsManager::getInstance().uthread_accept(sockfd, addr, addrlen);
+}
+
+int uthread_mutex_init(uthread_mutex_t *mutex) {
+    return UThreadsManager::getInstance().uthread_mutex_init(mutex);
+}
+
+int uthread_mutex_destroy(uthread_mutex_t *mutex) {
+    return UThreadsManager::getInstance().uthread_mutex_destroy(mutex);
+}
+
+int uthread_mutex_lock(uthread_mutex_t *mutex) {
+    return UThreadsManager::getInstance().uthread_mutex_lock(mutex);
+}
+
+int uthread_mutex_trylock(uthread_mutex_t *mutex) {
+    return UThreadsManager::getInstance().uthread_mutex_trylock(mutex);
+}
+
+int uthread_mutex_unlock(uthread_mutex_t *mutex) {
+    return UThreadsManager::getInstance().uthread_mutex_unlock(mutex);
+}
+
+int uthread_cond_init(uthread_cond_t *cond) {
+    return UThreadsManager::getInstance().uthread_cond_init(cond);
+}
+
+int uthread_cond_destroy(uthread_cond_t *cond) {
+    return UThreadsManager::getInstance().uthread_cond_destroy(cond);
+}
+
+int uthread_cond_wait(uthread_cond_t *cond, uthread_mutex_t *mutex) {
+    return UThreadsManager::getInstance().uthread_cond_wait(cond, mutex);
+}
+
+int uthread_cond_signal(uthread_cond_t *cond) {
+    return UThreadsManager::getInstance().uthread_cond_signal(cond);
+}
+
+int uthread_cond_broadcast(uthread_cond_t *cond) {
+    return UThreadsManager::getInstance().uthread_cond_broadcast(cond);
+}
+
+int uthread_sem_init(uthread_sem_t *sem, int count) {
+    return UThreadsManager::getInstance().uthread_sem_init(sem, count);
+}
+
+int uthread_sem_destroy(uthread_sem_t *sem) {
+    return UThreadsManager::getInstance().uthread_sem_destroy(sem);
+}
+
+int uthread_sem_wait(uthread_sem_t *sem) {
+    return UThreadsManager::getInstance().uthread_sem_wait(sem);
+}
+
+int uthread_sem_post(uthread_sem_t *sem) {
+    return UThreadsManager::getInstance().uthread_sem_post(sem);
+}
+
+int uthread_key_create(uthread_key_t *key, void (*destructor)(void *)) {
+    return UThreadsManager::getInstance().uthread_key_create(key, destructor);
+}
+
+int uthread_key_delete(uthread_key_t key) {
+    return UThreadsManager::getInstance().uthread_key_delete(key);
+}
+
+int uthread_setspecific(uthread_key_t key, const void *value) {
+    return UThreadsManager::uthread_setspecific(key, value);
+}
+
+void *uthread_getspecific(uthread_key_t key) {
+    return UThreadsManager::uthread_getspecific(key);
+}
+
 int uthread_get_tid() {
     return UThreadsManager::getInstance().uthread_get_tid();
 }
@@ -0,0 +1,674 @@
+#ifndef _UTHREADS_EXT_H
+#define _UTHREADS_EXT_H
+
+/*
+ * Extensions to the uthreads library interface declared in uthreads.h.
+ */
+
+#include "uthreads.h"
+#include "uthreads_stats.h"
+#include "uthreads_keys.h"
+#include "uthreads_trace.h"
+#include <cstddef>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+//A thread handle is its tid with the generation of the thread in the bits
+//above UTHREAD_TID_BITS. Every call that takes a tid also takes a handle,
+//and fails if the thread it was taken from was terminated, even when its
+//tid was reused since. A plain tid has generation 0 and is never stale.
+#define UTHREAD_TID_BITS 20
+#define UTHREAD_TID_MASK ((1 << UTHREAD_TID_BITS) - 1)
+#define UTHREAD_MAX_GENERATION ((1 << (31 - UTHREAD_TID_BITS)) - 1)
+
+//The amount of priorities of the priority policy, 0 is the lowest.
+#define UTHREAD_PRIORITY_LEVELS 8
+#define UTHREAD_DEFAULT_PRIORITY 0
+//The weights of the fair policy, a thread gets a share of the CPU
+//proportional to its weight.
+#define UTHREAD_MIN_WEIGHT 1
+#define UTHREAD_DEFAULT_WEIGHT 1024
+#define UTHREAD_MAX_WEIGHT 65536
+//The most threads uthread_pool_submit creates by default
+#define UTHREAD_DEFAULT_POOL_THREADS 16
+//The distinct stacks the profiler keeps by default, see uthread_config_t.
+#define UTHREAD_DEFAULT_PROFILE_STACKS 4096
+
+//The slices of the adaptive mode, in quantums, see uthread_config_t.
+#define UTHREAD_MIN_SLICE 1
+#define UTHREAD_INITIAL_SLICE 2
+#define UTHREAD_MAX_SLICE 16
+
+/**
+ * The policy that decides which READY thread runs next.
+ */
+typedef enum uthread_policy {
+    //Threads run in turns, in the order they became READY
+    UTHREAD_POLICY_ROUND_ROBIN,
+    //The READY thread of the highest priority runs, see uthread_set_priority
+    UTHREAD_POLICY_PRIORITY,
+    //The READY thread that ran the fewest quantums relative to its weight
+    //runs, see uthread_set_weight
+    UTHREAD_POLICY_FAIR
+} uthread_policy_t;
+
+/**
+ * The clock that ends quantums in the preemptive mode. Every worker gets its
+ * timer armed as a periodic timer, and the signal is delivered to the kernel
+ * thread of the worker. A worker with nothing to run disarms its timer until
+ * it runs a thread again, except for the virtual timer.
+ */
+typedef enum uthread_timer_source {
+    //The virtual time of the process (setitimer(ITIMER_VIRTUAL)) with a single
+    //worker, UTHREAD_TIMER_THREAD_CPU otherwise. The kernel samples CPU time
+    //at its tick, so quantums shorter than a tick (1-10 ms) get rounded up.
+    UTHREAD_TIMER_VIRTUAL,
+    //The CPU time of each worker (timer_create(CLOCK_THREAD_CPUTIME_ID)),
+    //with the same resolution as the virtual time.
+    UTHREAD_TIMER_THREAD_CPU,
+    //Wall-clock time (timer_create(CLOCK_MONOTONIC)), a high resolution timer
+    //that allows quantums of a few micro-seconds. Time a thread spends
+    //blocked in a system call counts towards its quantum.
+    UTHREAD_TIMER_MONOTONIC
+} uthread_timer_source_t;
+
+/**
+ * The limits and the mode of the thread library, see uthread_init_ex. Fill it
+ * with uthread_config_init first, so fields added later keep their defaults.
+ */
+typedef struct uthread_config {
+    //The length of a quantum in micro-seconds, must be set unless
+    //"preemptive" is 0.
+    int quantum_usecs;
+    //The amount of kernel threads, see uthread_init_workers. 1 by default.
+    int num_workers;
+    //0 for the cooperative mode, see uthread_init_cooperative. 1 by default.
+    int preemptive;
+    //UTHREAD_POLICY_ROUND_ROBIN by default.
+    uthread_policy_t policy;
+    //UTHREAD_TIMER_VIRTUAL by default.
+    uthread_timer_source_t timer_source;
+    //Nonzero for the adaptive mode, 0 by default. A thread runs for a slice of
+    //several quantums before it's preempted, starting at
+    //UTHREAD_INITIAL_SLICE. A thread whose slice ended gets a slice twice as
+    //long next time, up to UTHREAD_MAX_SLICE, and one that blocked, slept or
+    //yielded before gets one half as long, down to UTHREAD_MIN_SLICE. Threads
+    //with a slice shorter than the initial one are interactive: they're
+    //placed at the front of the READY threads list when their wait ends, and
+    //end the slice of the running thread at the next quantum.
+    int adaptive_quantum;
+    //The most threads that may exist at once, including the main thread.
+    //Between 1 and UTHREAD_MAX_THREADS, MAX_THREAD_NUM by default. Memory is
+    //only committed for the threads that are created.
+    int max_threads;
+    //The stack size of the threads created by uthread_spawn and
+    //uthread_spawn_handle, STACK_SIZE by default.
+    size_t stack_size;
+    //Whether every stack gets a guard page, 1 by default. A guarded stack
+    //costs two memory mappings and the kernel limits their amount (see
+    //vm.max_map_count, usually 65530), so beyond about 30k threads stacks
+    //must be unguarded.
+    int guard_stacks;
+    //The most threads uthread_pool_submit creates, positive,
+    //UTHREAD_DEFAULT_POOL_THREADS by default.
+    int pool_threads;
+    //Nonzero for the shared stack mode, the size in bytes of the stack the
+    //threads share, 0 by default. Threads created with the configured
+    //stack_size all run on it: a switch copies the live part of the stack
+    //of the thread switched out aside and the one of the thread switched in
+    //back, so an idle thread only takes the memory its frames use instead of
+    //a stack, at the cost of a copy per switch that grows with the depth.
+    //A preempted thread also keeps the signal frame, a few KB. Threads of
+    //uthread_spawn_with_stack with another size get a stack of their own.
+    //Pointers to the stack of a thread are only valid while it runs, so it
+    //must not hand them to other threads. Needs a single worker.
+    size_t shared_stack_size;
+    //The size of the event trace buffer in events, the newest ones are kept,
+    //0 for no buffer. UTHREAD_DEFAULT_TRACE_EVENTS by default. The buffer is
+    //only committed as it fills up, 32 bytes per event.
+    size_t trace_events;
+    //The amount of distinct stacks the profiler keeps, further ones are
+    //dropped, 0 for no profiler. UTHREAD_DEFAULT_PROFILE_STACKS by default.
+    //The tables are only committed as they fill up, about 300 bytes per stack.
+    size_t profile_stacks;
+} uthread_config_t;
+
+//The most threads uthread_init_ex accepts, every tid fits in UTHREAD_TID_BITS.
+#define UTHREAD_MAX_THREADS (UTHREAD_TID_MASK + 1)
+
+/**
+ * Fills the configuration with the defaults.
+ * @param config - The configuration.
+ */
+void uthread_config_init(uthread_config_t *config);
+
+/**
+ * Initializes the thread library with the given configuration. The other
+ * initialization functions are shorthands for it.
+ * @param config - The configuration, see uthread_config_init.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_init_ex(const uthread_config_t *config);
+
+/**
+ * Initializes the thread library like uthread_init, running the user threads
+ * on the given amount of kernel threads. Every worker has its own READY queue
+ * and preemption timer (counting its own CPU time), idle workers steal READY
+ * threads from the others. With a single worker this is uthread_init.
+ * @param quantum_usecs - The length of a quantum in micro-seconds.
+ * @param num_workers - The amount of kernel threads, usually one per core.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_init_workers(int quantum_usecs, int num_workers);
+
+/**
+ * Initializes the thread library like uthread_init_workers, with the given
+ * scheduling policy instead of round robin.
+ * @param quantum_usecs - The length of a quantum in micro-seconds.
+ * @param num_workers - The amount of kernel threads.
+ * @param policy - The scheduling policy.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_init_scheduler(int quantum_usecs, int num_workers, uthread_policy_t policy);
+
+/**
+ * Sets the priority of a thread under the priority policy. A thread only
+ * runs while no thread of a higher priority is READY. Threads start at
+ * UTHREAD_DEFAULT_PRIORITY, other policies ignore it.
+ * @param tid - The ID of the thread.
+ * @param priority - Between 0 and UTHREAD_PRIORITY_LEVELS - 1, higher runs first.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_set_priority(int tid, int priority);
+
+/**
+ * Sets the weight of a thread under the fair policy. READY threads share the
+ * quantums in proportion to their weights. Threads start at
+ * UTHREAD_DEFAULT_WEIGHT, other policies ignore it.
+ * @param tid - The ID of the thread.
+ * @param weight - Between UTHREAD_MIN_WEIGHT and UTHREAD_MAX_WEIGHT.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_set_weight(int tid, int weight);
+
+/**
+ * The function of a thread created with uthread_create.
+ * @param arg - The argument given to uthread_create.
+ * @return The exit value of the thread, see uthread_join.
+ */
+typedef void *(*uthread_routine_t)(void *arg);
+
+/**
+ * Creates a new joinable thread that runs routine(arg) and adds it to the end
+ * of the READY threads list. Unlike the threads of uthread_spawn, which are
+ * removed as soon as they terminate, a joinable thread keeps its ID and its
+ * exit value after it terminates until it's joined or detached.
+ * @param routine - The function of the new thread. Returning from it is
+ * uthread_exit with its return value.
+ * @param arg - Passed to the routine as is.
+ * @return On success, return the ID of the created thread. On failure, return -1.
+ */
+int uthread_create(uthread_routine_t routine, void *arg);
+
+/**
+ * Waits until a joinable thread terminates, the calling thread is BLOCKED
+ * meanwhile and runs right away when the thread terminates itself. Takes
+ * the exit value of the thread, a pointer that's handed over as is, and
+ * frees its ID. Each thread may be joined once. Fails rather than deadlock
+ * when the thread is the caller, or joins the caller directly or through a
+ * chain of joins.
+ * @param tid - The ID of the thread, or a handle of it.
+ * @param result - Where to store the exit value, may be NULL. A thread that
+ * was terminated by uthread_terminate has a NULL exit value.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_join(int tid, void **result);
+
+/**
+ * Makes a joinable thread detached: it's removed as soon as it terminates and
+ * nobody may join it. Detaching a terminated thread frees its ID.
+ * @param tid - The ID of the thread, or a handle of it.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_detach(int tid);
+
+/**
+ * Creates n joinable threads at once, thread i runs routine(args[i]). Costs a
+ * single critical section instead of one per thread, and none of the threads
+ * runs before all of them were created.
+ * @param routine - The function of the new threads, see uthread_create.
+ * @param args - The n arguments, or NULL to pass NULL to all of them.
+ * @param n - The amount of threads, positive.
+ * @param tids - Where to store the n IDs of the new threads.
+ * @return On success, return 0. On failure, return -1 and no thread is
+ * created, also when fewer than n IDs are available.
+ */
+int uthread_spawn_batch(uthread_routine_t routine, void *const args[], int n, int tids[]);
+
+/**
+ * Runs routine(arg) on a thread of the built-in pool. An idle pool thread
+ * takes the task, a new one is created if none is idle and there are fewer
+ * than the configured pool_threads, otherwise the task waits until a pool
+ * thread finishes its current one. Pool threads are never removed, so a task
+ * reuses the stack and the ID of an earlier one. Tasks run in the order they
+ * were submitted, their return value is dropped and they must not call
+ * uthread_exit, nobody may join them: signal a semaphore to report the result.
+ * @param routine - The function of the task.
+ * @param arg - Passed to the routine as is.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_pool_submit(uthread_routine_t routine, void *arg);
+
+/**
+ * A continuation of a stackless task, run by the task runners: threads the
+ * library creates, one per worker, that run the posted nodes one after the
+ * other on their own stacks. The node is owned by the caller and must stay
+ * alive until it runs, the C++20 tasks of uthreads_task.h keep it in their
+ * coroutine frame. A node is in a single queue at a time and never copied.
+ */
+typedef struct uthread_task_node {
+    //Called by a task runner, must not block: a blocked runner holds up the
+    //tasks queued after it.
+    void (*run)(struct uthread_task_node *node);
+    //Left to the caller, e.g. the coroutine to resume.
+    void *arg;
+    //The exit value of the thread given to uthread_task_join.
+    void *result;
+    //Set by the library
+    struct uthread_task_node *next;
+    unsigned long long wake_time;
+} uthread_task_node_t;
+
+/**
+ * Queues a node to be run by a task runner, after the nodes queued before
+ * it. The first call creates the task runners.
+ * @param node - The node, its run function set.
+ * @return On success, return 0. On failure, return -1, also when no task
+ * runner can be created.
+ */
+int uthread_task_post(uthread_task_node_t *node);
+
+/**
+ * Queues a node once the given wall-clock time passed, see uthread_sleep_ns.
+ * @param node - The node, its run function set.
+ * @param nsecs - The duration in nanoseconds, positive.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_task_sleep_ns(uthread_task_node_t *node, long long nsecs);
+
+/**
+ * Joins a thread from a task: the node is queued once the thread terminated,
+ * with its exit value in node->result, and the thread is removed like
+ * uthread_join would. Queued right away if it terminated already.
+ * @param node - The node, its run function set.
+ * @param tid - The ID of a joinable thread nobody joins yet, or a handle of
+ * it.
+ * @return On success, return 0. On failure, return -1 and the node is never
+ * queued.
+ */
+int uthread_task_join(uthread_task_node_t *node, int tid);
+
+/**
+ * Terminates the calling thread with the given exit value, like
+ * uthread_terminate on itself. Called by the main thread it ends the process.
+ * @param result - The exit value, see uthread_join.
+ */
+void uthread_exit(void *result);
+
+/**
+ * Sets how long a thread runs before it's preempted, in place of the slice
+ * the adaptive mode picks or the single quantum otherwise. Has no effect in
+ * the cooperative mode.
+ * @param tid - The ID of the thread.
+ * @param quantum_usecs - The length in micro-seconds, rounded up to whole
+ * quantums of the library. 0 gives the thread back its default slice.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_set_quantum(int tid, int quantum_usecs);
+
+/**
+ * Creates a new thread like uthread_spawn.
+ * @param entry_point - The function of the new thread.
+ * @return On success, return the handle of the created thread, see
+ * UTHREAD_TID_BITS. On failure, return -1.
+ */
+int uthread_spawn_handle(thread_entry_point entry_point);
+
+/**
+ * @param tid - The ID of an existing thread, or a handle of it.
+ * @return On success, return the handle of the thread, see UTHREAD_TID_BITS.
+ * On failure, return -1.
+ */
+int uthread_get_handle(int tid);
+
+/**
+ * Resumes a blocked thread like uthread_resume, from anywhere: any kernel
+ * thread, including ones the library didn't create, and signal handlers.
+ * It's lock free and async-signal-safe, the thread is resumed by the
+ * scheduler at its next switch, or right away by an idle worker. Nothing is
+ * printed, and a thread that doesn't exist by then is ignored.
+ * uthread_resume called from a kernel thread that isn't a worker goes
+ * through the same queue.
+ * @param tid - The ID of the thread, or a handle of it.
+ * @return On success, return 0. On failure (the ID is out of range),
+ * return -1.
+ */
+int uthread_wake(int tid);
+
+/**
+ * Initializes the thread library in cooperative mode: no timer is armed and
+ * threads switch only when they yield, block, sleep or terminate, so no
+ * signal is masked or delivered on any switch. Quantums count switches.
+ * @param num_workers - The amount of kernel threads, see uthread_init_workers.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_init_cooperative(int num_workers);
+
+/**
+ * Moves the calling thread to the end of the READY threads list and starts a
+ * new quantum, like the end of a quantum does. The calling thread keeps
+ * running if no other thread is READY. This is the only way a thread that
+ * doesn't block or sleep gives up the CPU in cooperative mode.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_yield();
+
+/**
+ * Blocks the RUNNING thread for the given wall-clock time, unlike
+ * uthread_sleep whose quantums only pass while threads run or the process
+ * is idle. The thread is READY again at the first tick or switch after the
+ * time passed, or right away when its worker is idle. The main thread may
+ * sleep too. While no thread is READY the workers sleep in the kernel until
+ * the next sleeper is due, a thread is woken or a descriptor is ready.
+ * @param nsecs - The duration in nanoseconds, positive.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_sleep_ns(long long nsecs);
+
+/**
+ * Creates a new thread like uthread_spawn, running on a stack of the given
+ * size instead of the configured one. Unless configured otherwise stacks
+ * are guarded, overflowing one terminates the process with an error message.
+ * @param entry_point - The function of the new thread.
+ * @param stack_size - The size of the thread stack in bytes.
+ * @return On success, return the ID of the created thread. On failure, return -1.
+ */
+int uthread_spawn_with_stack(thread_entry_point entry_point, size_t stack_size);
+
+//The size of the synchronization objects. Their content is private to the
+//library, a zero filled object is initialized: an unlocked mutex, a condition
+//variable nobody waits on, a semaphore with a count of 0.
+#define UTHREAD_SYNC_OBJECT_SIZE 64
+
+/**
+ * A mutual exclusion lock. Locking a free mutex and unlocking one nobody waits
+ * for are a single atomic instruction, a waiting thread is handed the mutex
+ * directly when it's unlocked. Statically allocated mutexes need no
+ * initialization, others are initialized with uthread_mutex_init or
+ * UTHREAD_MUTEX_INITIALIZER.
+ */
+typedef union uthread_mutex {
+    unsigned char opaque[UTHREAD_SYNC_OBJECT_SIZE];
+    long long align;
+} uthread_mutex_t;
+
+/**
+ * A condition variable, always used together with the same mutex.
+ */
+typedef union uthread_cond {
+    unsigned char opaque[UTHREAD_SYNC_OBJECT_SIZE];
+    long long align;
+} uthread_cond_t;
+
+/**
+ * A counting semaphore. Waiting while the count is positive and posting while
+ * nobody waits are a single atomic instruction, a posted unit is handed
+ * directly to the first waiting thread.
+ */
+typedef union uthread_sem {
+    unsigned char opaque[UTHREAD_SYNC_OBJECT_SIZE];
+    long long align;
+} uthread_sem_t;
+
+#define UTHREAD_MUTEX_INITIALIZER {{0}}
+#define UTHREAD_COND_INITIALIZER {{0}}
+#define UTHREAD_SEM_INITIALIZER {{0}}
+
+/**
+ * Initializes an unlocked mutex.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_mutex_init(uthread_mutex_t *mutex);
+
+/**
+ * Checks that nothing uses the mutex anymore.
+ * @return On success, return 0. If the mutex is locked return -1.
+ */
+int uthread_mutex_destroy(uthread_mutex_t *mutex);
+
+/**
+ * Locks the mutex, the calling thread waits in FIFO order while another
+ * thread owns it. It's an error to lock a mutex the calling thread owns.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_mutex_lock(uthread_mutex_t *mutex);
+
+/**
+ * Locks the mutex only if it's unlocked.
+ * @return 0 if the mutex was locked, -1 otherwise.
+ */
+int uthread_mutex_trylock(uthread_mutex_t *mutex);
+
+/**
+ * Unlocks the mutex. If threads wait for it, the first one becomes its owner
+ * and runs right away in place of the calling thread, which goes to the end
+ * of the READY threads list. It's an error to unlock a mutex the calling
+ * thread doesn't own.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_mutex_unlock(uthread_mutex_t *mutex);
+
+/**
+ * Initializes a condition variable nobody waits on.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_cond_init(uthread_cond_t *cond);
+
+/**
+ * Checks that nothing uses the condition variable anymore.
+ * @return On success, return 0. If threads wait on it return -1.
+ */
+int uthread_cond_destroy(uthread_cond_t *cond);
+
+/**
+ * Unlocks the mutex and waits on the condition variable, atomically. Returns
+ * once the thread was signaled and owns the mutex again. Like any condition
+ * variable, the caller should check its condition again in a loop.
+ * @param mutex - A mutex the calling thread owns.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_cond_wait(uthread_cond_t *cond, uthread_mutex_t *mutex);
+
+/**
+ * Wakes up the first thread waiting on the condition variable. The thread is
+ * moved to the wait queue of its mutex, so it doesn't run before it can own
+ * the mutex.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_cond_signal(uthread_cond_t *cond);
+
+/**
+ * Wakes up all the threads waiting on the condition variable, see
+ * uthread_cond_signal.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_cond_broadcast(uthread_cond_t *cond);
+
+/**
+ * Initializes a semaphore with the given count.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_sem_init(uthread_sem_t *sem, int count);
+
+/**
+ * Checks that nothing uses the semaphore anymore.
+ * @return On success, return 0. If threads wait on it return -1.
+ */
+int uthread_sem_destroy(uthread_sem_t *sem);
+
+/**
+ * Decrements the count of the semaphore, the calling thread waits in FIFO
+ * order while it's 0.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_sem_wait(uthread_sem_t *sem);
+
+/**
+ * Increments the count of the semaphore. If threads wait on it, the unit is
+ * given to the first one, which runs right away in place of the calling
+ * thread.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_sem_post(uthread_sem_t *sem);
+
+/**
+ * Creates a key, the value of every thread for it starts as NULL. Native
+ * thread_local variables are shared by all the threads of a worker, use
+ * keys for data of a single thread.
+ * @param key - Where to store the new key.
+ * @param destructor - Called with the value of a terminating thread unless
+ * it's NULL, may be NULL. The destructors run before the thread is removed,
+ * on the thread itself if it terminates itself or returns, on the thread
+ * that calls uthread_terminate otherwise. A destructor that sets values
+ * again causes another round, up to UTHREAD_DESTRUCTOR_ITERATIONS. They
+ * don't run when the process ends. Pool threads never terminate, so their
+ * values are kept from one task to the next.
+ * @return On success, return 0. On failure, return -1, also when
+ * UTHREAD_KEYS_MAX keys exist.
+ */
+int uthread_key_create(uthread_key_t *key, void (*destructor)(void *));
+
+/**
+ * Deletes a key, the values of the threads for it are dropped without
+ * calling its destructor. The key must not be used anymore, its slot may
+ * be reused by uthread_key_create.
+ * @param key - The key.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_key_delete(uthread_key_t key);
+
+/**
+ * Sets the value of the calling thread for a key. Never blocks or enters
+ * the scheduler, the value is stored in the control block of the thread.
+ * @param key - A key returned by uthread_key_create.
+ * @param value - The value.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_setspecific(uthread_key_t key, const void *value);
+
+/**
+ * Takes the value of the calling thread for a key, a single load of the
+ * running thread and one of its slot.
+ * @param key - A key returned by uthread_key_create.
+ * @return The value, NULL if it wasn't set. A value set for a deleted key
+ * never shows up for a later key in the same slot.
+ */
+void *uthread_getspecific(uthread_key_t key);
+
+/**
+ * Copies the counters of the scheduler, see uthreads_stats.h. The counters
+ * are always kept, they cost a clock read per switch. The copy takes no lock,
+ * so while threads run the counters may be a few events apart.
+ * @param stats - Where to copy them.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_stats(uthread_stats_t *stats);
+
+/**
+ * Copies the counters of the thread with the given ID, including the time it
+ * spent so far in its current state.
+ * @param tid - The ID of the thread.
+ * @param stats - Where to copy them.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_thread_stats(int tid, uthread_thread_stats_t *stats);
+
+/**
+ * Starts or stops recording scheduler events (switches and their reasons,
+ * spawns, wakeups, ticks...) in the trace buffer, see uthreads_trace.h. The
+ * trace is off by default. A recorded event costs a clock read and a plain
+ * increment of the buffer position, done under the scheduler lock every
+ * writer already holds. A disabled trace costs a single load per event.
+ * @param on - Nonzero to record the events from now on.
+ * @return On success, return 0. On failure (no trace buffer), return -1.
+ */
+int uthread_trace_enable(int on);
+
+/**
+ * Writes the events in the trace buffer, from the oldest to the newest, in the
+ * format of uthreads_trace.h. May be called while events are recorded, the
+ * ones written meanwhile may be left out. tools/trace_to_json.cpp converts the
+ * dump for chrome://tracing and Perfetto.
+ * @param fd - The file descriptor to write to.
+ * @return On success, the amount of events written. On failure, return -1.
+ */
+int uthread_trace_dump(int fd);
+
+/**
+ * Starts or stops the sampling profiler. Every expiration of the preemption
+ * timer then samples the running thread: the interrupted instruction and up
+ * to 31 callers, found through the frame pointers, so code built with
+ * -fomit-frame-pointer (the default at -O1 and above) shows short stacks.
+ * With the default timer source the samples follow the CPU time of the
+ * threads, with UTHREAD_TIMER_MONOTONIC the wall-clock time. The profiler is
+ * off by default and needs the preemptive mode.
+ * @param on - Nonzero to take samples from now on.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_profile_enable(int on);
+
+/**
+ * Writes the samples in the folded stack format of flamegraph.pl, one line
+ * per thread and stack, "uthread <tid>;<outermost caller>;...;<sampled
+ * function> <samples>". Frames are named after the dynamic symbols (link
+ * with -rdynamic to name the functions of the executable), and as
+ * "<module>+0x<offset>" for addr2line otherwise. The samples of a terminated
+ * thread stay with its ID.
+ * @param fd - The file descriptor to write to.
+ * @param tid - The ID of a thread, -1 for every thread.
+ * @return On success, the amount of lines written. On failure, return -1.
+ */
+int uthread_profile_dump(int fd, int tid);
+
+/**
+ * Blocks the calling thread until the given file descriptor is ready, the
+ * other threads keep running meanwhile. The main thread may wait as well.
+ * @param fd - The file descriptor, epoll(7) must support it.
+ * @param events - EPOLLIN to wait for input, EPOLLOUT for output or both.
+ * @return On success, return 0. On failure, return -1.
+ */
+int uthread_wait_fd(int fd, int events);
+
+/**
+ * read(2) that blocks only the calling thread, the descriptor is put in
+ * non-blocking mode.
+ * @return As read(2).
+ */
+ssize_t uthread_read(int fd, void *buf, size_t count);
+
+/**
+ * write(2) that blocks only the calling thread, the descriptor is put in
+ * non-blocking mode.
+ * @return As write(2).
+ */
+ssize_t uthread_write(int fd, const void *buf, size_t count);
+
+/**
+ * accept(2) that blocks only the calling thread, the listening socket is put
+ * in non-blocking mode and so is the accepted one.
+ * @return As accept(2).
+ */
+int uthread_accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen);
+
+#endif //_UTHREADS_EXT_H
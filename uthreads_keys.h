@@ -0,0 +1,20 @@
+#ifndef _UTHREADS_KEYS_H
+#define _UTHREADS_KEYS_H
+
+/*
+ * The limits of the thread-specific data keys, see uthread_key_create in
+ * uthreads_ext.h. Every thread keeps a slot per key in its control block.
+ */
+
+//The amount of keys that may exist at once.
+#define UTHREAD_KEYS_MAX 32
+//How many times the destructors of a terminating thread are run while they
+//keep setting new values.
+#define UTHREAD_DESTRUCTOR_ITERATIONS 4
+
+/**
+ * A thread-specific data key, every thread has its own value for it.
+ */
+typedef int uthread_key_t;
+
+#endif //_UTHREADS_KEYS_H
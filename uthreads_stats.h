@@ -0,0 +1,47 @@
+#ifndef _UTHREADS_STATS_H
+#define _UTHREADS_STATS_H
+
+/*
+ * The counters the uthreads library keeps about its threads and its
+ * scheduler, see uthread_stats and uthread_thread_stats in uthreads_ext.h.
+ */
+
+//Buckets of the run-queue depth histogram: bucket 0 counts an empty queue
+//and bucket i > 0 a depth in [2^(i-1), 2^i), the last one has no upper bound.
+#define UTHREAD_RUN_QUEUE_BUCKETS 12
+
+/**
+ * The counters of a single thread. Times are wall-clock nanoseconds. A
+ * change between READY and BLOCKED is timed at the last switch or tick of the
+ * worker that made it, so it may be counted up to a quantum early.
+ */
+typedef struct uthread_thread_stats {
+    //Switches out of the thread because it yielded, blocked, slept, waited
+    //or terminated
+    unsigned long long voluntary_switches;
+    //Switches out of the thread at the end of a quantum
+    unsigned long long involuntary_switches;
+    unsigned long long ready_ns;
+    unsigned long long running_ns;
+    //Blocked, sleeping or waiting for I/O or a synchronization object
+    unsigned long long blocked_ns;
+    unsigned long long sleep_count;
+    //The longest the thread waited in a READY queue before running
+    unsigned long long max_ready_wait_ns;
+} uthread_thread_stats_t;
+
+/**
+ * The counters of the scheduler, summed over all the workers.
+ */
+typedef struct uthread_stats {
+    //Switches from one thread to another
+    unsigned long long switches;
+    unsigned long long timer_ticks;
+    //Time spent handling timer ticks, until the switch to the next thread
+    unsigned long long timer_handler_ns;
+    unsigned long long timer_handler_max_ns;
+    //The depth of the READY queue of the worker at every scheduling decision
+    unsigned long long run_queue_depth[UTHREAD_RUN_QUEUE_BUCKETS];
+} uthread_stats_t;
+
+#endif //_UTHREADS_STATS_H
@@ -0,0 +1,333 @@
+#ifndef _UTHREADS_TASK_H
+#define _UTHREADS_TASK_H
+
+/*
+ * Stackless tasks: C++20 coroutines run by the task runners of the uthreads
+ * library, see uthread_task_post in uthreads_ext.h. A task has no stack of
+ * its own, only a coroutine frame on the heap that holds its locals across
+ * co_await, so it costs a few hundred bytes instead of a thread stack. The
+ * runners are ordinary threads scheduled with the others, so tasks share the
+ * CPU with the threads according to the scheduling policy.
+ * A task must not call the blocking functions of the library (uthread_join,
+ * uthread_sleep_ns, uthread_mutex_lock...), it would hold up the tasks of its
+ * runner. It co_awaits their task versions instead.
+ */
+
+#if __cplusplus < 202002L
+#error "uthreads_task.h requires C++20"
+#endif
+
+#include "uthreads_ext.h"
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace uthread {
+
+template<typename T = void>
+class task;
+
+namespace detail {
+
+    /**
+     * The run function of the nodes of suspended coroutines.
+     * @param node - The node, its arg is the address of the coroutine.
+     */
+    inline void resume_node(uthread_task_node_t *node) {
+        std::coroutine_handle<>::from_address(node->arg).resume();
+    }
+
+    /**
+     * The part of the promise of a task that doesn't depend on its value.
+     */
+    class promise_base {
+        public:
+            //Resumed when the task completes, the task that awaits it
+            std::coroutine_handle<> continuation;
+            //Whether nobody owns the task, see spawn, so it frees itself
+            bool is_detached = false;
+            //Resumes the task when it's posted, see spawn and yield
+            uthread_task_node_t node{};
+            std::exception_ptr exception;
+
+            std::suspend_always initial_suspend() noexcept {
+                return {};
+            }
+
+            /**
+             * Hands the runner straight to the awaiting task.
+             */
+            struct final_awaiter {
+                bool await_ready() noexcept {
+                    return false;
+                }
+
+                template<typename Promise>
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+                    promise_base &promise = handle.promise();
+                    if (promise.continuation)
+                        return promise.continuation;
+                    if (promise.is_detached)
+                        handle.destroy();
+                    return std::noop_coroutine();
+                }
+
+                void await_resume() noexcept {}
+            };
+
+            final_awaiter final_suspend() noexcept {
+                return {};
+            }
+
+            void unhandled_exception() {
+                exception = std::current_exception();
+            }
+    };
+
+    template<typename T>
+    class promise : public promise_base {
+        public:
+            std::optional<T> value;
+
+            task<T> get_return_object();
+
+            template<typename U>
+            void return_value(U &&result) {
+                value.emplace(std::forward<U>(result));
+            }
+
+            T take() {
+                if (exception)
+                    std::rethrow_exception(exception);
+                return std::move(*value);
+            }
+    };
+
+    template<>
+    class promise<void> : public promise_base {
+        public:
+            task<void> get_return_object();
+
+            void return_void() {}
+
+            void take() {
+                if (exception)
+                    std::rethrow_exception(exception);
+            }
+    };
+
+    /**
+     * Suspends the awaiting task until its node is queued by the library.
+     */
+    class node_awaiter {
+        protected:
+            uthread_task_node_t node{};
+
+            /**
+             * Hands the node to the library.
+             * @return 0 if the node will be queued, -1 otherwise.
+             */
+            virtual int submit() = 0;
+
+        public:
+            virtual ~node_awaiter() = default;
+
+            bool await_ready() noexcept {
+                return false;
+            }
+
+            bool await_suspend(std::coroutine_handle<> handle) {
+                node.run = resume_node;
+                node.arg = handle.address();
+                //Keeps running when the node is never queued. Nothing of the
+                //awaiter may be touched once it is, the frame may be gone.
+                return submit() == 0;
+            }
+    };
+}
+
+/**
+ * A coroutine that runs when it's awaited by another task, spawned, or
+ * waited for with sync_wait. Owns its frame, which is freed with the task.
+ * @tparam T - The type of the value of co_return, void for none.
+ */
+template<typename T>
+class task {
+    public:
+        using promise_type = detail::promise<T>;
+
+    private:
+        std::coroutine_handle<promise_type> handle;
+
+        template<typename U>
+        friend void spawn(task<U> &&t);
+
+    public:
+        explicit task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+        task(task &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+        task(const task &) = delete;
+
+        task &operator=(const task &) = delete;
+
+        ~task() {
+            if (handle)
+                handle.destroy();
+        }
+
+        bool await_ready() const noexcept {
+            return !handle || handle.done();
+        }
+
+        /**
+         * Starts the task on the runner of the awaiting one, which resumes
+         * once the task completes.
+         */
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+            handle.promise().continuation = awaiting;
+            return handle;
+        }
+
+        /**
+         * @return The value of co_return, an exception of the task is
+         * rethrown.
+         */
+        T await_resume() {
+            return handle.promise().take();
+        }
+};
+
+namespace detail {
+    template<typename T>
+    task<T> promise<T>::get_return_object() {
+        return task<T>(std::coroutine_handle<promise<T>>::from_promise(*this));
+    }
+
+    inline task<void> promise<void>::get_return_object() {
+        return task<void>(std::coroutine_handle<promise<void>>::from_promise(*this));
+    }
+}
+
+/**
+ * Runs a task on a task runner without waiting for it, the task frees
+ * itself when it completes. Its value and exception are dropped.
+ * @param t - The task, not started yet.
+ */
+template<typename T>
+void spawn(task<T> &&t) {
+    auto handle = std::exchange(t.handle, nullptr);
+    detail::promise_base &promise = handle.promise();
+    promise.is_detached = true;
+    promise.node.run = detail::resume_node;
+    promise.node.arg = handle.address();
+    if (uthread_task_post(&promise.node) != 0)
+        handle.destroy();
+}
+
+/**
+ * co_await sleep_for(nsecs) suspends the task for the given wall-clock
+ * time, see uthread_sleep_ns. Doesn't suspend if nsecs isn't positive.
+ */
+class sleep_for : public detail::node_awaiter {
+    private:
+        long long nsecs;
+
+    protected:
+        int submit() override {
+            return nsecs > 0 ? uthread_task_sleep_ns(&node, nsecs) : -1;
+        }
+
+    public:
+        explicit sleep_for(long long nsecs) : nsecs(nsecs) {}
+
+        void await_resume() noexcept {}
+};
+
+/**
+ * co_await yield() lets the tasks posted before it run first.
+ */
+class yield : public detail::node_awaiter {
+    protected:
+        int submit() override {
+            return uthread_task_post(&node);
+        }
+
+    public:
+        void await_resume() noexcept {}
+};
+
+/**
+ * co_await join(tid, &result) suspends the task until the joinable thread
+ * terminates, see uthread_join.
+ * @return On success, return 0. On failure, return -1 without suspending.
+ */
+class join : public detail::node_awaiter {
+    private:
+        int tid;
+        void **result;
+        int status = -1;
+
+    protected:
+        int submit() override {
+            //Set first: once the node is queued the task may resume on
+            //another runner before uthread_task_join returns
+            status = 0;
+            int res = uthread_task_join(&node, tid);
+            if (res != 0)
+                status = -1;
+            return res;
+        }
+
+    public:
+        join(int tid, void **result) : tid(tid), result(result) {}
+
+        int await_resume() noexcept {
+            if (status == 0 && result != nullptr)
+                *result = node.result;
+            return status;
+        }
+};
+
+/**
+ * Runs a task from a thread and blocks the thread until the task completed.
+ * @param t - The task, not started yet.
+ * @return The value of co_return, an exception of the task is rethrown.
+ */
+template<typename T>
+T sync_wait(task<T> &&t) {
+    struct waiter {
+        uthread_sem_t done;
+        std::optional<std::conditional_t<std::is_void_v<T>, bool, T>> value;
+        std::exception_ptr exception;
+
+        static task<void> drive(task<T> &t, waiter &w) {
+            try {
+                if constexpr (std::is_void_v<T>) {
+                    co_await t;
+                    w.value.emplace(true);
+                } else
+                    w.value.emplace(co_await t);
+            }
+            catch (...) {
+                w.exception = std::current_exception();
+            }
+            //The last use of w, the thread may return right after
+            uthread_sem_post(&w.done);
+        }
+    } w{};
+    task<T> owned = std::move(t);
+    uthread_sem_init(&w.done, 0);
+    spawn(waiter::drive(owned, w));
+    uthread_sem_wait(&w.done);
+    if (w.exception)
+        std::rethrow_exception(w.exception);
+    if constexpr (!std::is_void_v<T>)
+        return std::move(*w.value);
+}
+
+}
+
+#endif //_UTHREADS_TASK_H
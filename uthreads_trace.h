@@ -0,0 +1,88 @@
+#ifndef _UTHREADS_TRACE_H
+#define _UTHREADS_TRACE_H
+
+/*
+ * The scheduler event trace of the uthreads library, see uthread_trace_enable
+ * and uthread_trace_dump in uthreads_ext.h, and the file format of the dump,
+ * read by tools/trace_to_json.cpp.
+ */
+
+#include <stdint.h>
+
+//The size of the trace buffer in events by default, see uthread_config_t.
+#define UTHREAD_DEFAULT_TRACE_EVENTS 65536
+//The first bytes of a dump, "UTRC" in a little endian file.
+#define UTHREAD_TRACE_MAGIC 0x43525455u
+#define UTHREAD_TRACE_VERSION 1
+
+typedef enum uthread_trace_type {
+    //Unless noted otherwise, arg is the ID of the thread that caused the
+    //event, -1 when it isn't one of the library.
+
+    //A thread was created.
+    UTHREAD_TRACE_SPAWN,
+    //A thread started running on a worker, arg is the ID of the previous
+    //one, -1 when the worker was idle.
+    UTHREAD_TRACE_SWITCH_IN,
+    //A thread stopped running, arg is a uthread_trace_reason_t.
+    UTHREAD_TRACE_SWITCH_OUT,
+    //uthread_block.
+    UTHREAD_TRACE_BLOCK,
+    //uthread_resume or uthread_wake ended the block of a thread.
+    UTHREAD_TRACE_RESUME,
+    //A sleeping thread is due, arg is the thread running on the worker that
+    //noticed.
+    UTHREAD_TRACE_WAKE,
+    //uthread_terminate or uthread_exit.
+    UTHREAD_TRACE_TERMINATE,
+    //The preemption timer of a worker fired, tid is its running thread or
+    //-1 when it was idle, arg is 0.
+    UTHREAD_TRACE_TICK
+} uthread_trace_type_t;
+
+typedef enum uthread_trace_reason {
+    //Its slice ended.
+    UTHREAD_TRACE_PREEMPTED,
+    //uthread_yield, or a higher priority thread became READY.
+    UTHREAD_TRACE_YIELDED,
+    //uthread_block.
+    UTHREAD_TRACE_BLOCKED,
+    //uthread_sleep or uthread_sleep_ns.
+    UTHREAD_TRACE_SLEPT,
+    //A mutex, condition variable, semaphore, join or file descriptor.
+    UTHREAD_TRACE_WAITED,
+    UTHREAD_TRACE_TERMINATED
+} uthread_trace_reason_t;
+
+/**
+ * A single event, the records of a dump.
+ */
+typedef struct uthread_trace_event {
+    //CLOCK_MONOTONIC nanoseconds.
+    uint64_t time_ns;
+    //The thread the event is about.
+    int32_t tid;
+    //The worker the event happened on, -1 for other kernel threads.
+    int16_t worker;
+    //A uthread_trace_type_t.
+    uint16_t type;
+    //Depends on the type.
+    int32_t arg;
+    uint32_t reserved;
+} uthread_trace_event_t;
+
+/**
+ * The start of a dump, followed by "count" events from the oldest to the
+ * newest.
+ */
+typedef struct uthread_trace_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t event_size;
+    uint32_t count;
+    //Events that were overwritten before the dump, the buffer keeps the
+    //newest ones.
+    uint64_t dropped;
+} uthread_trace_header_t;
+
+#endif //_UTHREADS_TRACE_H